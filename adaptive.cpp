@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+#include "adaptive.h"
+#include "machete/machete.h"
+#include "gorilla/gorilla.h"
+#include "chimp/chimp.h"
+#include "elf/elf.h"
+#include "elf/defs.h"
+#include "wrapper.h"
+
+// The block is sampled as a few contiguous runs, since the XOR codecs and
+// the Lorenzo predictor only look at neighbouring values.
+#define SAMPLE_RUNS     4
+#define RUN_LEN         64
+
+// Fixed per-block header cost of every candidate, in bits.
+static const double header_bits[ADAPTIVE_CHOICES] = {
+        12 * 8,                 // Gorilla: length + first value
+        12 * 8,                 // Chimp: length + first value
+        4 * 8,                  // Elf: length
+        56 * 8,                 // Machete: machete + lorenzo + hybrid + ovlq headers
+        12 * 8,                 // ZSTD: frame header
+};
+
+static inline ssize_t machete_decompress_wrapper(uint8_t* in, ssize_t len, double* out, double error) {
+        return machete_decompress<lorenzo1, hybrid>(in, len, out);
+}
+
+static struct {
+        ssize_t (*compress) (double* input, ssize_t len, uint8_t** output, double error);
+        ssize_t (*decompress) (uint8_t* input, ssize_t size, double* output, double error);
+} candidates[ADAPTIVE_CHOICES] = {
+        { gorilla_encode,                       gorilla_decode},
+        { chimp_encode,                         chimp_decode},
+        { elf_encode,                           elf_decode},
+        { machete_compress<lorenzo1, hybrid>,   machete_decompress_wrapper},
+        { zstd_compress,                        zstd_decompress},
+};
+
+// Blocks a codec over budget sits out before it is measured again: its cost depends on the
+// data, so a codec that was slow on earlier blocks may fit the budget on later ones.
+#define REPROBE_BLOCKS  64
+
+static double budget = 0;
+// Moving average of the observed compression cost (ns/value) of each candidate,
+// per thread so concurrent callers don't race on it. A codec is only measured when it
+// is picked, until then (and again when it is re-probed) it is unmeasured, not free.
+static thread_local double cost[ADAPTIVE_CHOICES] = {0};
+static thread_local bool measured[ADAPTIVE_CHOICES] = {false};
+// Blocks each codec has been left out for being over budget
+static thread_local int32_t excluded[ADAPTIVE_CHOICES] = {0};
+
+void adaptive_set_budget(double ns_per_value) {
+        budget = ns_per_value;
+}
+
+/////////////////////////////////// Estimators ///////////////////////////////////
+
+static double gorilla_bits(uint64_t* data, ssize_t n) {
+        double bits = 0;
+        int64_t prevLeading = -1, prevTrailing = 0;
+        for (int i = 1; i < n; i++) {
+                uint64_t vDelta = data[i] ^ data[i-1];
+                if (vDelta == 0) {
+                        bits += 1;
+                        continue;
+                }
+                int64_t leading = __builtin_clzl(vDelta);
+                int64_t trailing = __builtin_ctzl(vDelta);
+                leading = (leading >= 32) ? 31 : leading;
+                if (prevLeading != -1 && leading >= prevLeading && trailing >= prevTrailing) {
+                        bits += 2 + 64 - prevLeading - prevTrailing;
+                } else {
+                        prevLeading = leading;
+                        prevTrailing = trailing;
+                        bits += 2 + 5 + 6 + 64 - leading - trailing;
+                }
+        }
+        return bits;
+}
+
+static const int32_t leadingRound[] = {
+        0, 0, 0, 0, 0, 0, 0, 0,
+        8, 8, 8, 8, 12, 12, 12, 12,
+        16, 16, 18, 18, 20, 20, 22, 22,
+        24, 24, 24, 24, 24, 24, 24, 24,
+        24, 24, 24, 24, 24, 24, 24, 24,
+        24, 24, 24, 24, 24, 24, 24, 24,
+        24, 24, 24, 24, 24, 24, 24, 24,
+        24, 24, 24, 24, 24, 24, 24, 24
+};
+
+// Chimp128 with the reference search restricted to the sampled run.
+static double chimp_bits(uint64_t* data, ssize_t n) {
+        double bits = 0;
+        int32_t indices[256];
+        std::fill(indices, indices + 256, -1);
+        int32_t storedLeadingZeros = INT32_MAX;
+        indices[data[0] & 0xff] = 0;
+        for (int i = 1; i < n; i++) {
+                int32_t key = data[i] & 0xff;
+                uint64_t delta = data[i] ^ data[i-1];
+                int32_t trailingZeros = 0;
+                if (indices[key] >= 0 && i - indices[key] < 128) {
+                        uint64_t d = data[i] ^ data[indices[key]];
+                        trailingZeros = d ? __builtin_ctzl(d) : 64;
+                        if (trailingZeros > 13) {
+                                delta = d;
+                        } else {
+                                trailingZeros = 0;
+                        }
+                }
+                indices[key] = i;
+
+                if (delta == 0) {
+                        bits += 9;
+                        storedLeadingZeros = 65;
+                } else {
+                        int32_t leadingZeros = leadingRound[__builtin_clzl(delta)];
+                        if (trailingZeros > 13) {
+                                bits += 18 + 64 - leadingZeros - trailingZeros;
+                                storedLeadingZeros = 65;
+                        } else if (leadingZeros == storedLeadingZeros) {
+                                bits += 2 + 64 - leadingZeros;
+                        } else {
+                                storedLeadingZeros = leadingZeros;
+                                bits += 5 + 64 - leadingZeros;
+                        }
+                }
+        }
+        return bits;
+}
+
+// Elf is only a candidate when every sampled value has its mantissa erased,
+// otherwise a negative estimate is returned.
+static double elf_bits(double* in, ssize_t n) {
+        double bits = 0;
+        int lastBetaStar = __INT32_MAX__;
+        int storedLeadingZeros = __INT32_MAX__;
+        int storedTrailingZeros = __INT32_MAX__;
+        uint64_t storedVal = 0;
+        bool first = true;
+        for (int i = 0; i < n; i++) {
+                DOUBLE data = {.d = in[i]};
+                if (in[i] == 0.0) {
+                        bits += 2;
+                        continue;
+                }
+                int* alphaAndBetaStar = getAlphaAndBetaStar(in[i], lastBetaStar);
+                int e = ((int) (data.i >> 52)) & 0x7ff;
+                int eraseBits = 52 - (getFAlpha(alphaAndBetaStar[0]) + e - 1023);
+                uint64_t mask = 0xffffffffffffffffUL << (eraseBits > 0 ? eraseBits : 0);
+                int betaStar = alphaAndBetaStar[1];
+                delete [] alphaAndBetaStar;
+                if (eraseBits <= 4 || (~mask & data.i) == 0) {
+                        return -1;
+                }
+                bits += (betaStar == lastBetaStar) ? 1 : 6;
+                lastBetaStar = betaStar;
+
+                uint64_t value = mask & data.i;
+                uint64_t _xor = storedVal ^ value;
+                storedVal = value;
+                if (first) {
+                        first = false;
+                        bits += 69 - __builtin_ctzl(value);
+                } else if (_xor == 0) {
+                        bits += 2;
+                } else {
+                        int leadingZeros = leadingRound[__builtin_clzl(_xor)];
+                        int trailingZeros = __builtin_ctzl(_xor);
+                        if (leadingZeros == storedLeadingZeros && trailingZeros >= storedTrailingZeros) {
+                                bits += 2 + 64 - storedLeadingZeros - storedTrailingZeros;
+                        } else {
+                                storedLeadingZeros = leadingZeros;
+                                storedTrailingZeros = trailingZeros;
+                                int centerBits = 64 - leadingZeros - trailingZeros;
+                                bits += (centerBits <= 16 ? 8 : 10) + centerBits;
+                        }
+                }
+        }
+        return bits;
+}
+
+// Order-0 entropy (in bits) of `n` symbols given their sorted copy.
+static double sorted_entropy(int64_t* sorted, ssize_t n, ssize_t* distinct) {
+        double h = 0;
+        *distinct = 0;
+        for (int i = 0; i < n; ) {
+                int j = i;
+                while (j < n && sorted[j] == sorted[i]) j++;
+                double p = (double) (j - i) / n;
+                h -= (j - i) * log2(p);
+                (*distinct)++;
+                i = j;
+        }
+        return h;
+}
+
+// Lorenzo residual entropy, plus the cost of storing every distinct residual once.
+static double machete_bits(double* in, ssize_t n, double error) {
+        int64_t q[SAMPLE_RUNS * RUN_LEN];
+        double e2 = error * 0.999 * 2;
+        double max_diff = e2 * INT32_MAX;
+        double predicted = in[0];
+        int outliers = 0;
+        ssize_t m = 0;
+        for (int i = 1; i < n; i++) {
+                double d = in[i] - predicted;
+                if (fabs(d) > max_diff) {
+                        outliers++;
+                        predicted = in[i];
+                        continue;
+                }
+                q[m] = (int64_t) nearbyint(d / e2);
+                predicted += q[m] * e2;
+                m++;
+        }
+        if (m == 0) {
+                return outliers * 64.0;
+        }
+        std::sort(q, q + m);
+        ssize_t distinct;
+        double h = sorted_entropy(q, m, &distinct);
+        double sym_bits = 64 - __builtin_clzl(std::max(llabs(q[0]), llabs(q[m-1])) | 1) + 2;
+        return h + distinct * sym_bits + outliers * 64.0;
+}
+
+// Byte-level order-0 entropy of the values that differ from their predecessor;
+// repeated values are assumed to fold into LZ matches.
+static double zstd_bits(uint64_t* data, ssize_t n) {
+        int32_t freq[256] = {0};
+        int literals = 0;
+        int repeats = 0;
+        for (int i = 0; i < n; i++) {
+                if (i > 0 && data[i] == data[i-1]) {
+                        repeats++;
+                        continue;
+                }
+                uint8_t* bytes = (uint8_t*) &data[i];
+                for (int j = 0; j < 8; j++) {
+                        freq[bytes[j]]++;
+                }
+                literals += 8;
+        }
+        double h = 0;
+        for (int i = 0; i < 256; i++) {
+                if (freq[i]) {
+                        h -= freq[i] * log2((double) freq[i] / literals);
+                }
+        }
+        return h + repeats * 2;
+}
+
+AdaptiveChoice adaptive_select(double* in, ssize_t len, double error) {
+        double bits[ADAPTIVE_CHOICES] = {0};
+        bool eligible[ADAPTIVE_CHOICES] = {true, true, true, error > 0 && len >= 10, true};
+
+        ssize_t runs = len <= SAMPLE_RUNS * RUN_LEN ? 1 : SAMPLE_RUNS;
+        ssize_t run_len = runs == 1 ? len : RUN_LEN;
+        ssize_t stride = runs == 1 ? 0 : (len - RUN_LEN) / (SAMPLE_RUNS - 1);
+        for (int r = 0; r < runs; r++) {
+                double* run = in + r * stride;
+                bits[ADAPTIVE_GORILLA] += gorilla_bits((uint64_t*) run, run_len);
+                bits[ADAPTIVE_CHIMP] += chimp_bits((uint64_t*) run, run_len);
+                bits[ADAPTIVE_ZSTD] += zstd_bits((uint64_t*) run, run_len);
+                if (eligible[ADAPTIVE_ELF]) {
+                        double b = elf_bits(run, run_len);
+                        eligible[ADAPTIVE_ELF] = b >= 0;
+                        bits[ADAPTIVE_ELF] += b;
+                }
+                if (eligible[ADAPTIVE_MACHETE]) {
+                        bits[ADAPTIVE_MACHETE] += machete_bits(run, run_len, error);
+                }
+        }
+
+        AdaptiveChoice best = ADAPTIVE_GORILLA;
+        double best_bits = INFINITY;
+        double scale = (double) len / (runs * run_len);
+        for (int c = 0; c < ADAPTIVE_CHOICES; c++) {
+                if (!eligible[c]) {
+                        continue;
+                }
+                if (budget > 0 && measured[c] && cost[c] > budget) {
+                        if (++excluded[c] < REPROBE_BLOCKS) {
+                                continue;
+                        }
+                        // let it compete again, its next measurement replaces the old cost
+                        excluded[c] = 0;
+                        measured[c] = false;
+                }
+                double b = bits[c] * scale + header_bits[c];
+                if (b < best_bits) {
+                        best_bits = b;
+                        best = (AdaptiveChoice) c;
+                }
+        }
+        return best;
+}
+
+/////////////////////////////////// Codec ///////////////////////////////////
+
+static inline int64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+ssize_t adaptive_compress(double* in, ssize_t len, uint8_t** out, double error) {
+        AdaptiveChoice c = adaptive_select(in, len, error);
+        uint8_t* payload;
+        int64_t start = budget > 0 ? now_ns() : 0;
+        ssize_t size = candidates[c].compress(in, len, &payload, error);
+        if (__builtin_expect(size < 0, 0)) { // e.g. Machete size overflow, Gorilla always works
+                c = ADAPTIVE_GORILLA;
+                size = gorilla_encode(in, len, &payload, error);
+        }
+        if (budget > 0) {
+                double ns = (double) (now_ns() - start) / len;
+                cost[c] = measured[c] ? cost[c] * 0.875 + ns * 0.125 : ns;
+                measured[c] = true;
+        }
+
+        *out = (uint8_t*) malloc(size + 1);
+        (*out)[0] = c;
+        __builtin_memcpy(*out + 1, payload, size);
+        free(payload);
+        return size + 1;
+}
+
+ssize_t adaptive_decompress(uint8_t* in, ssize_t len, double* out, double error) {
+        uint8_t c = in[0];
+        if (__builtin_expect(c >= ADAPTIVE_CHOICES, 0)) {
+                return -1;
+        }
+        return candidates[c].decompress(in + 1, len - 1, out, error);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// Codecs the adaptive meta-compressor can pick from.
+// The chosen one is recorded in the first byte of every block.
+enum AdaptiveChoice {
+        ADAPTIVE_GORILLA,
+        ADAPTIVE_CHIMP,
+        ADAPTIVE_ELF,
+        ADAPTIVE_MACHETE,
+        ADAPTIVE_ZSTD,
+        ADAPTIVE_CHOICES,
+};
+
+/**
+ * Limit the codecs considered to those whose observed compression cost
+ * is no more than `ns_per_value` nanoseconds per value.
+ * A codec is measured when it is picked, so one never picked yet is still considered,
+ * and one over budget is given another try every 64 blocks.
+ * 0 (the default) disables the limit.
+ */
+void adaptive_set_budget(double ns_per_value);
+
+/**
+ * Estimate the compressed size (in bits) of `in` for every candidate codec
+ * from a small sample of the block, and return the cheapest one within budget.
+ * Machete is only considered when error > 0.
+ */
+AdaptiveChoice adaptive_select(double* in, ssize_t len, double error);
+
+ssize_t adaptive_compress(double* in, ssize_t len, uint8_t** out, double error);
+ssize_t adaptive_decompress(uint8_t* in, ssize_t len, double* out, double error);
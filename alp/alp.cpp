@@ -0,0 +1,295 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "alp.h"
+#include "Arena/Arena.h"
+#include "BitPack/BitPack.h"
+
+// A block is
+//      AlpHeader
+//      the chunks of ALP_CHUNK packed v * 10^e / 10^f - base, width * ALP_LANES words each
+//      the exceptions as is (double), then their positions (uint32_t)
+// The chunks are packed lane-interleaved (inc/BitPack/BitPack.h), so the loops over the lanes
+// vectorize. The last chunk only keeps the words of the rows it uses.
+
+#define ALP_LANES               16
+#define ALP_CHUNK               (64 * ALP_LANES)
+#define ALP_MAX_EXPONENT        18
+#define ALP_SAMPLES             32
+#define ALP_FIRST_SAMPLES       8       // all exponent/factor pairs are tried on these
+#define ALP_CANDIDATES          5       // the best pairs of the first round, tried on all samples
+#define ALP_EXCEPTION_BITS      (64 + 32)
+#define ALP_RAW                 0xff    // width of a block stored as is
+
+// 2^52 + 2^51: x + ALP_MAGIC rounds |x| < 2^51 to an integer held in the low mantissa bits
+#define ALP_MAGIC               0x1.8p52
+#define ALP_MAX_INT             0x1p51
+
+typedef struct __attribute__((__packed__)) {
+        uint32_t len;
+        uint32_t exceptions;
+        int64_t base;
+        uint8_t exponent;
+        uint8_t factor;
+        uint8_t width;
+        uint8_t pad[5];         // keeps the payload 8-byte aligned
+        uint64_t payload[0];
+} AlpHeader;
+
+static const double alp_exp10[] =
+{1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+static const double alp_frac10[] =
+{1e0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9,
+1e-10, 1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18};
+
+static inline uint64_t bits_of(double d) {
+        uint64_t u;
+        memcpy(&u, &d, sizeof(u));
+        return u;
+}
+
+static inline double double_of(uint64_t u) {
+        double d;
+        memcpy(&d, &u, sizeof(d));
+        return d;
+}
+
+// u < 2^52 as a double without a (scalar only) int-to-double conversion
+static inline double u2d(uint64_t u) {
+        return double_of(u | bits_of(0x1p52)) - 0x1p52;
+}
+
+typedef struct {
+        double exp_e, frac_f;   // encoding multiplies by these
+        double exp_f, frac_e;   // and decoding by these, in this order
+} AlpFactors;
+
+static inline AlpFactors alp_factors(int e, int f) {
+        return {alp_exp10[e], alp_frac10[f], alp_exp10[f], alp_frac10[e]};
+}
+
+/**
+ * Rounds v * 10^e / 10^f to `n` (as a double, and as an integer in `code`),
+ * returns 1 for an exception, unless n * 10^f / 10^e gives v back bit for bit.
+ * Only integer operations make the result: GCC doesn't vectorize a loop counting
+ * double comparisons, as in alp_encode.
+ */
+static inline uint64_t alp_encode_value(double v, AlpFactors k, int64_t* code) {
+        double x = v * k.exp_e * k.frac_f;
+        double y = x + ALP_MAGIC;
+        double n = y - ALP_MAGIC;
+        *code = bits_of(y) - bits_of(ALP_MAGIC);
+        uint64_t diff = bits_of(n * k.exp_f * k.frac_e) ^ bits_of(v);
+        // bit 63 is set when |x| >= ALP_MAX_INT (or x is NaN)
+        uint64_t big = bits_of(ALP_MAX_INT) - 1 - (bits_of(x) & ~(1UL << 63));
+        uint64_t miss = diff | (big >> 63);
+        return (miss | -miss) >> 63;
+}
+
+static inline int alp_width(int64_t lo, int64_t hi) {
+        return hi > lo ? 64 - __builtin_clzl(hi - lo) : 0;
+}
+
+static inline ssize_t alp_packed_words(ssize_t len, int width) {
+        ssize_t rows = (len % ALP_CHUNK + ALP_LANES - 1) / ALP_LANES;
+        return (len / ALP_CHUNK * width + (rows * width + 63) / 64) * ALP_LANES;
+}
+
+/**
+ * Bits to code `count` samples with the pair (e, f), ALP_EXCEPTION_BITS for every value that doesn't round trip.
+ */
+static int64_t alp_cost(const double* sample, int count, int e, int f) {
+        AlpFactors k = alp_factors(e, f);
+        int exceptions = 0;
+        int64_t lo = INT64_MAX, hi = INT64_MIN;
+        for (int s = 0; s < count; s++) {
+                int64_t code;
+                uint64_t miss = alp_encode_value(sample[s], k, &code);
+                exceptions += miss;
+                lo = !miss && code < lo ? code : lo;
+                hi = !miss && code > hi ? code : hi;
+        }
+        return (int64_t) alp_width(lo, hi) * count + exceptions * ALP_EXCEPTION_BITS;
+}
+
+/**
+ * Picks the exponent/factor pair for the block in two rounds, as ALP does for a row group and its vectors:
+ * every pair on ALP_FIRST_SAMPLES values, then the ALP_CANDIDATES best of them on ALP_SAMPLES values.
+ */
+static void alp_choose(const double* in, ssize_t len, int* exponent, int* factor) {
+        // a block shorter than ALP_SAMPLES gives some values twice, which weighs all pairs the same
+        double sample[ALP_SAMPLES];
+        for (int s = 0; s < ALP_SAMPLES; s++) {
+                sample[s] = in[s * len / ALP_SAMPLES];
+        }
+        // every ALP_SAMPLES / ALP_FIRST_SAMPLES-th sample, still spread over the block
+        double first[ALP_FIRST_SAMPLES];
+        for (int s = 0; s < ALP_FIRST_SAMPLES; s++) {
+                first[s] = sample[s * (ALP_SAMPLES / ALP_FIRST_SAMPLES)];
+        }
+
+        // candidates sorted by cost, on ties the larger exponent and factor go first: with a few
+        // samples many pairs tie, and those multiplying by 10^f / 10^e round trip more often (as in ALP)
+        int64_t cost[ALP_CANDIDATES];
+        int pair[ALP_CANDIDATES][2];
+        int candidates = 0;
+        for (int e = 0; e <= ALP_MAX_EXPONENT; e++) {
+                for (int f = 0; f <= e; f++) {
+                        int64_t c = alp_cost(first, ALP_FIRST_SAMPLES, e, f);
+                        int k = candidates < ALP_CANDIDATES ? candidates++ : ALP_CANDIDATES;
+                        for (; k > 0 && c <= cost[k-1]; k--) {
+                                if (k < ALP_CANDIDATES) {
+                                        cost[k] = cost[k-1];
+                                        pair[k][0] = pair[k-1][0];
+                                        pair[k][1] = pair[k-1][1];
+                                }
+                        }
+                        if (k < ALP_CANDIDATES) {
+                                cost[k] = c;
+                                pair[k][0] = e;
+                                pair[k][1] = f;
+                        }
+                }
+        }
+
+        int64_t best = INT64_MAX;
+        for (int k = 0; k < candidates; k++) {
+                int64_t c = alp_cost(sample, ALP_SAMPLES, pair[k][0], pair[k][1]);
+                // candidates of equal cost are in order of preference already
+                if (c < best) {
+                        best = c;
+                        *exponent = pair[k][0];
+                        *factor = pair[k][1];
+                }
+        }
+}
+
+/**
+ * Packs `rows` rows (at most 64) of ALP_LANES values of `width` (at most 52) bits
+ * into ceil(rows * width / 64) * ALP_LANES words.
+ */
+static void alp_pack(const uint64_t* in, uint64_t* out, int width, int rows) {
+        bitpack<uint64_t, ALP_LANES>(in, out, width, rows);
+}
+
+static void alp_unpack(const uint64_t* in, uint64_t* out, int width, int rows) {
+        bitunpack<uint64_t, ALP_LANES>(in, out, width, rows);
+}
+
+ssize_t alp_encode(double* in, ssize_t len, uint8_t** out, double error) {
+        ArenaScope scope;
+        int e, f;
+        alp_choose(in, len, &e, &f);
+
+        ssize_t chunks = (len + ALP_CHUNK - 1) / ALP_CHUNK;
+        ssize_t padded = chunks * ALP_CHUNK;
+        AlpFactors k = alp_factors(e, f);
+        int64_t* codes = (int64_t*) scratch_alloc(padded * sizeof(int64_t));
+        ssize_t exceptions = 0;
+        for (ssize_t i = 0; i < len; i++) {
+                exceptions += alp_encode_value(in[i], k, &codes[i]);
+        }
+
+        // exceptions (and the padding) take the code of a regular value, so they don't widen the frame,
+        // they are rare enough to be checked again rather than flagged in the loop above
+        int64_t filler = 0;
+        int64_t code;
+        for (ssize_t i = 0; i < len; i++) {
+                if (!alp_encode_value(in[i], k, &code)) {
+                        filler = code;
+                        break;
+                }
+        }
+        uint32_t* positions = (uint32_t*) scratch_alloc(exceptions * sizeof(uint32_t));
+        for (ssize_t i = 0, n = 0; n < exceptions; i++) {
+                if (alp_encode_value(in[i], k, &code)) {
+                        positions[n++] = i;
+                        codes[i] = filler;
+                }
+        }
+        for (ssize_t i = len; i < padded; i++) {
+                codes[i] = filler;
+        }
+
+        int64_t lo = filler, hi = filler;
+        for (ssize_t i = 0; i < padded; i++) {
+                lo = codes[i] < lo ? codes[i] : lo;
+                hi = codes[i] > hi ? codes[i] : hi;
+        }
+        int width = alp_width(lo, hi);
+
+        ssize_t packed_size = alp_packed_words(len, width) * sizeof(uint64_t);
+        ssize_t size = sizeof(AlpHeader) + packed_size + exceptions * (sizeof(double) + sizeof(uint32_t));
+        if (size >= (ssize_t) (sizeof(AlpHeader) + len * sizeof(double))) {
+                size = sizeof(AlpHeader) + len * sizeof(double);
+                width = ALP_RAW;
+        }
+        *out = (uint8_t*) malloc(size);
+        AlpHeader* header = (AlpHeader*) *out;
+        header->len = len;
+        header->base = lo;
+        header->exponent = e;
+        header->factor = f;
+        header->width = width;
+        if (width == ALP_RAW) {
+                header->exceptions = 0;
+                memcpy(header->payload, in, len * sizeof(double));
+                scratch_free(positions);
+                scratch_free(codes);
+                return size;
+        }
+        header->exceptions = exceptions;
+
+        uint64_t* frame = (uint64_t*) codes;
+        for (ssize_t i = 0; i < padded; i++) {
+                frame[i] = codes[i] - lo;
+        }
+        for (ssize_t c = 0; c < chunks; c++) {
+                ssize_t m = len - c * ALP_CHUNK < ALP_CHUNK ? len - c * ALP_CHUNK : ALP_CHUNK;
+                alp_pack(frame + c * ALP_CHUNK, header->payload + c * width * ALP_LANES, width, (m + ALP_LANES - 1) / ALP_LANES);
+        }
+        double* values = (double*) (header->payload + alp_packed_words(len, width));
+        for (ssize_t k = 0; k < exceptions; k++) {
+                values[k] = in[positions[k]];
+        }
+        memcpy(values + exceptions, positions, exceptions * sizeof(uint32_t));
+        scratch_free(positions);
+        scratch_free(codes);
+        return size;
+}
+
+ssize_t alp_decode(uint8_t* in, ssize_t len, double* out, double error) {
+        AlpHeader* header = (AlpHeader*) in;
+        ssize_t n = header->len;
+        if (header->width == ALP_RAW) {
+                memcpy(out, header->payload, n * sizeof(double));
+                return n;
+        }
+
+        int width = header->width;
+        double base = header->base;
+        double fact = alp_exp10[header->factor];
+        double frac = alp_frac10[header->exponent];
+        ssize_t chunks = (n + ALP_CHUNK - 1) / ALP_CHUNK;
+        uint64_t buffer[ALP_CHUNK];
+        for (ssize_t c = 0; c < chunks; c++) {
+                ssize_t m = n - c * ALP_CHUNK < ALP_CHUNK ? n - c * ALP_CHUNK : ALP_CHUNK;
+                alp_unpack(header->payload + c * width * ALP_LANES, buffer, width, (m + ALP_LANES - 1) / ALP_LANES);
+                double* o = out + c * ALP_CHUNK;
+                // |base + u| < 2^51, so the sum is the exact code
+                for (ssize_t i = 0; i < m; i++) {
+                        o[i] = (u2d(buffer[i]) + base) * fact * frac;
+                }
+        }
+
+        double* values = (double*) (header->payload + alp_packed_words(n, width));
+        uint32_t* positions = (uint32_t*) (values + header->exceptions);
+        for (ssize_t k = 0; k < header->exceptions; k++) {
+                out[positions[k]] = values[k];
+        }
+        return n;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif 
+
+// ALP (Adaptive Lossless floating-Point): decimals become integers v * 10^e / 10^f with one
+// exponent/factor pair per block, which are frame-of-reference bit-packed; the values that
+// don't survive the round trip are patched in as exceptions.
+ssize_t alp_encode(double* in, ssize_t len, uint8_t** out, double error);
+ssize_t alp_decode(uint8_t* in, ssize_t len, double* out, double error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "batch.h"
+#include "machete/machete.h"
+#include "Arena/Arena.h"
+
+// Column payloads start at multiples of BATCH_ALIGN from the block, the column codecs
+// load whole words and expect their input aligned like a malloc'd block.
+#define BATCH_ALIGN             8
+#define BATCH_PAD(n)            (((n) + BATCH_ALIGN - 1) / BATCH_ALIGN * BATCH_ALIGN)
+
+typedef struct __attribute__((__packed__)) {
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t sizes[0];
+} BatchHeader;
+
+// Per-worker scratch for the cross-column predictor, reused across columns and calls.
+static thread_local std::vector<double> recon_buffer;
+static thread_local std::vector<double> residual_buffer;
+// Per-worker arena for the column codecs, used when the thread has none bound.
+static thread_local Arena worker_arena;
+
+static inline ssize_t machete_decompress_wrapper(uint8_t* in, ssize_t len, double* out, double error) {
+        return machete_decompress<lorenzo1, hybrid>(in, len, out);
+}
+
+/**
+ * Columns are handed out in (even, odd) pairs, so the worker coding an odd column
+ * has just coded the column it is predicted from.
+ */
+static ssize_t batch_compress_columns(double* in, ssize_t rows, int cols, uint8_t** out, double error,
+                ColumnCompressor compress, ColumnDecompressor decompress, bool cross) {
+        std::vector<uint8_t*> blocks(cols, NULL);
+        std::vector<ssize_t> sizes(cols, 0);
+        std::vector<uint8_t> modes(cols, BATCH_DIRECT);
+        ssize_t status = 0;
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int p = 0; p < (cols + 1) / 2; p++) {
+                Arena* bound = arena_bound() ? arena_bound() : &worker_arena;
+                Arena* prev = arena_bind(bound);
+                for (int c = 2 * p; c < cols && c < 2 * p + 2; c++) {
+                        double* column = in + c * rows;
+                        sizes[c] = compress(column, rows, &blocks[c], error);
+                        if (cross && c % 2 == 1 && sizes[c] >= 0 && sizes[c-1] >= 0) {
+                                recon_buffer.resize(2 * rows);
+                                residual_buffer.resize(rows);
+                                decompress(blocks[c-1], sizes[c-1], recon_buffer.data(), error);
+                                for (ssize_t i = 0; i < rows; i++) {
+                                        residual_buffer[i] = column[i] - recon_buffer[i];
+                                }
+                                uint8_t* residual_block;
+                                ssize_t residual_size = compress(residual_buffer.data(), rows, &residual_block, error);
+                                if (residual_size >= 0 && residual_size < sizes[c]) {
+                                        free(blocks[c]);
+                                        blocks[c] = residual_block;
+                                        sizes[c] = residual_size;
+                                        modes[c] = BATCH_CROSS;
+                                } else if (residual_size >= 0) {
+                                        free(residual_block);
+                                }
+                        }
+                        if (sizes[c] < 0) {
+                                blocks[c] = NULL;
+                                #pragma omp atomic write
+                                status = sizes[c];
+                        }
+                }
+                arena_bind(prev);
+        }
+
+        ssize_t total = BATCH_PAD(sizeof(BatchHeader) + cols * (sizeof(uint32_t) + sizeof(uint8_t)));
+        for (int c = 0; c < cols; c++) {
+                total += sizes[c] > 0 ? BATCH_PAD(sizes[c]) : 0;
+        }
+        if (status < 0) {
+                for (int c = 0; c < cols; c++) {
+                        free(blocks[c]);
+                }
+                return status;
+        }
+
+        // the padding is zeroed so equal inputs give equal blocks
+        *out = (uint8_t*) calloc(total, 1);
+        BatchHeader* header = (BatchHeader*) *out;
+        header->rows = rows;
+        header->cols = cols;
+        uint8_t* payload = (uint8_t*) (header->sizes + cols);
+        __builtin_memcpy(payload, modes.data(), cols);
+        payload = *out + BATCH_PAD(payload + cols - *out);
+        for (int c = 0; c < cols; c++) {
+                header->sizes[c] = sizes[c];
+                __builtin_memcpy(payload, blocks[c], sizes[c]);
+                payload += BATCH_PAD(sizes[c]);
+                free(blocks[c]);
+        }
+        return total;
+}
+
+/**
+ * Every column is decoded straight into `out`, so the codec must write exactly `rows` values.
+ */
+static ssize_t batch_decompress_columns(uint8_t* in, ssize_t len, double* out, double error, ColumnDecompressor decompress) {
+        BatchHeader* header = (BatchHeader*) in;
+        ssize_t rows = header->rows;
+        int cols = header->cols;
+        uint8_t* modes = (uint8_t*) (header->sizes + cols);
+
+        std::vector<uint8_t*> blocks(cols);
+        uint8_t* payload = in + BATCH_PAD(modes + cols - in);
+        for (int c = 0; c < cols; c++) {
+                blocks[c] = payload;
+                payload += BATCH_PAD(header->sizes[c]);
+        }
+
+        ssize_t status = rows * cols;
+        #pragma omp parallel for schedule(dynamic)
+        for (int p = 0; p < (cols + 1) / 2; p++) {
+                Arena* bound = arena_bound() ? arena_bound() : &worker_arena;
+                Arena* prev = arena_bind(bound);
+                for (int c = 2 * p; c < cols && c < 2 * p + 2; c++) {
+                        double* column = out + c * rows;
+                        if (decompress(blocks[c], header->sizes[c], column, error) != rows) {
+                                #pragma omp atomic write
+                                status = -1;
+                                continue;
+                        }
+                        if (modes[c] == BATCH_CROSS) {
+                                double* reference = column - rows;
+                                for (ssize_t i = 0; i < rows; i++) {
+                                        column[i] += reference[i];
+                                }
+                        }
+                }
+                arena_bind(prev);
+        }
+        return status;
+}
+
+ssize_t batch_compress(double* in, ssize_t rows, int cols, uint8_t** out, double error, ColumnCompressor compress) {
+        return batch_compress_columns(in, rows, cols, out, error, compress, NULL, false);
+}
+
+ssize_t batch_decompress(uint8_t* in, ssize_t len, double* out, double error, ColumnDecompressor decompress) {
+        return batch_decompress_columns(in, len, out, error, decompress);
+}
+
+ssize_t batch_machete_compress(double* in, ssize_t rows, int cols, uint8_t** out, double error, bool cross) {
+        return batch_compress_columns(in, rows, cols, out, error,
+                machete_compress<lorenzo1, hybrid>, machete_decompress_wrapper, cross);
+}
+
+ssize_t batch_machete_decompress(uint8_t* in, ssize_t len, double* out, double error) {
+        return batch_decompress_columns(in, len, out, error, machete_decompress_wrapper);
+}
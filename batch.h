@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// Batch compression of multivariate series, stored column-major: column c holds
+// rows values starting at in + c * rows. Every column is compressed on its own
+// OpenMP worker into one block with the layout
+//      BatchHeader | uint32 sizes[cols] | uint8 modes[cols] | column payloads
+// where every column payload is padded to 8 bytes.
+
+typedef ssize_t (*ColumnCompressor) (double* input, ssize_t len, uint8_t** output, double error);
+typedef ssize_t (*ColumnDecompressor) (uint8_t* input, ssize_t size, double* output, double error);
+
+enum BatchColumnMode {
+        BATCH_DIRECT,           // the column itself
+        BATCH_CROSS,            // residual against the reconstructed previous column
+};
+
+ssize_t batch_compress(double* in, ssize_t rows, int cols, uint8_t** out, double error, ColumnCompressor compress);
+ssize_t batch_decompress(uint8_t* in, ssize_t len, double* out, double error, ColumnDecompressor decompress);
+
+/**
+ * Machete over every column. With `cross` set, every odd column is also coded as its
+ * residual against the reconstruction of the even column before it (the neighbour
+ * channel at the same timestamp), and the smaller of the two encodings is kept.
+ * Requires error > 0.
+ */
+ssize_t batch_machete_compress(double* in, ssize_t rows, int cols, uint8_t** out, double error, bool cross);
+ssize_t batch_machete_decompress(uint8_t* in, ssize_t len, double* out, double error);
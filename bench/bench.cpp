@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include "machete/defs.h"
+#include "gorilla/gorilla.h"
+#include "chimp/chimp.h"
+#include "elf/elf.h"
+#include "alp/alp.h"
+#include "BitStream/BitWriter.h"
+#include "BitStream/BitReader.h"
+#include "lfzip/lfzip_predictor.cpp"
+
+// Kernel micro-benchmarks on synthetic data.
+// Every case runs over BENCH_LEN values and reports the best of BENCH_REPEAT runs,
+// so a regression in one hot loop shows up without the rest of a pipeline around it.
+
+#define BENCH_LEN       (1 << 16)
+#define BENCH_REPEAT    20
+
+// elf/defs.h redefines the DOUBLE union of machete/defs.h, so the one utility is declared here
+int* getAlphaAndBetaStar(double v, int lastBetaStar);
+
+static inline double now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// keeps results alive so the measured loops are not optimized away
+static volatile uint64_t sink;
+
+/**
+ * Runs `kernel` BENCH_REPEAT times and prints the best time per value,
+ * `value_size` is the width of one uncompressed value for the MB/s column.
+ */
+template<typename Kernel>
+static void run(const char* name, ssize_t values, ssize_t value_size, Kernel kernel) {
+        double best = INFINITY;
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+                double start = now_ns();
+                kernel();
+                double t = now_ns() - start;
+                best = t < best ? t : best;
+        }
+        printf("%-36s %9.3f ns/value %10.1f MB/s\n", name, best / values,
+                values * value_size / (best / 1e9) / 1024 / 1024);
+        fflush(stdout);
+}
+
+/////////////////////////////// Synthetic inputs ///////////////////////////////
+
+// Symbols drawn uniformly from 2^bits values around 0, so the entropy is exactly `bits` bits.
+static void gen_symbols(int32_t* out, ssize_t len, int bits) {
+        int32_t range = 1 << bits;
+        for (ssize_t i = 0; i < len; i++) {
+                out[i] = rand() % range - range / 2;
+        }
+}
+
+// A random walk of decimals with `digits` fractional digits, the usual input of the XOR codecs.
+static void gen_decimals(double* out, ssize_t len, int digits) {
+        double scale = pow(10, digits);
+        int64_t v = 100 * scale;
+        for (ssize_t i = 0; i < len; i++) {
+                v += rand() % 200 - 100;
+                out[i] = v / scale;
+        }
+}
+
+// A smooth signal with noise of amplitude `noise`, the usual input of the predictors.
+static void gen_signal(double* out, ssize_t len, double noise) {
+        for (ssize_t i = 0; i < len; i++) {
+                out[i] = 50 * sin(i * 0.001) + noise * (rand() / (double) RAND_MAX - 0.5);
+        }
+}
+
+/////////////////////////////// Cases ///////////////////////////////
+
+static void bench_bitstream() {
+        static const int widths[] = {1, 5, 13, 32};
+        std::vector<uint32_t> buffer(BENCH_LEN + 1);
+        char name[64];
+        for (int width : widths) {
+                uint64_t mask = (1UL << width) - 1;
+                sprintf(name, "BitWriter write %d bits", width);
+                run(name, BENCH_LEN, sizeof(uint32_t), [&]() {
+                        BitWriter writer;
+                        initBitWriter(&writer, buffer.data(), buffer.size());
+                        for (ssize_t i = 0; i < BENCH_LEN; i++) {
+                                write(&writer, i & mask, width);
+                        }
+                        sink = flush(&writer);
+                });
+                sprintf(name, "BitReader peek/forward %d bits", width);
+                run(name, BENCH_LEN, sizeof(uint32_t), [&]() {
+                        BitReader reader;
+                        initBitReader(&reader, buffer.data(), buffer.size());
+                        uint64_t sum = 0;
+                        for (ssize_t i = 0; i < BENCH_LEN; i++) {
+                                sum += peek(&reader, width);
+                                forward(&reader, width);
+                        }
+                        sink = sum;
+                });
+        }
+}
+
+static void bench_huffman() {
+        static const int entropies[] = {1, 4, 8, 12};
+        std::vector<int32_t> symbols(BENCH_LEN), decoded(BENCH_LEN);
+        char name[64];
+        for (int bits : entropies) {
+                gen_symbols(symbols.data(), BENCH_LEN, bits);
+
+                // same steps as huffman_encode, keeping the code stream and the codebook apart
+                std::unordered_map<int32_t, size_t> freq;
+                for (int32_t s : symbols) {
+                        freq[s]++;
+                }
+                HufTree* nodes;
+                HufTree* root = huffman_build_tree(freq, nodes);
+                EncodeCodebook encode_codebook;
+                std::vector<int32_t> vals(freq.size());
+                ssize_t total_bitlen = huffman_build_encode_codebook(root, encode_codebook, vals.data());
+                scratch_free(nodes);
+                std::vector<uint8_t> stored(freq.size() * (sizeof(int32_t) + sizeof(int16_t)));
+                huffman_store_codebook(encode_codebook, vals.data(), freq.size(), stored.data());
+                ssize_t code_size = (total_bitlen + 31) / 32 * 4;
+                std::vector<uint8_t> code(code_size + 4);
+                huffman_store_code(encode_codebook, symbols.data(), BENCH_LEN, code.data(), code_size);
+
+                DecodeCodebook codebook;
+                ssize_t index_bitlen = huffman_build_decode_codebook(reinterpret_cast<int32_t*>(stored.data()),
+                        reinterpret_cast<int16_t*>(stored.data() + freq.size() * sizeof(int32_t)), freq.size(), codebook);
+                sprintf(name, "huffman_decode_data %d-bit entropy", bits);
+                run(name, BENCH_LEN, sizeof(int32_t), [&]() {
+                        huffman_decode_data(code.data(), code_size, codebook, index_bitlen, decoded.data(), BENCH_LEN);
+                });
+                scratch_free(codebook);
+                if (memcmp(symbols.data(), decoded.data(), BENCH_LEN * sizeof(int32_t))) {
+                        printf("huffman_decode_data mismatch\n");
+                }
+        }
+}
+
+static void bench_ovlq() {
+        static const int entropies[] = {1, 4, 8, 16};
+        std::vector<int32_t> symbols(BENCH_LEN), decoded(BENCH_LEN);
+        char name[64];
+        for (int bits : entropies) {
+                gen_symbols(symbols.data(), BENCH_LEN, bits);
+                uint8_t* encoded;
+                ssize_t size = ovlq_encode(symbols.data(), BENCH_LEN, &encoded);
+                sprintf(name, "ovlq_decode %d-bit entropy", bits);
+                run(name, BENCH_LEN, sizeof(int32_t), [&]() {
+                        ovlq_decode(encoded, size, decoded.data());
+                });
+                scratch_free(encoded);
+                if (memcmp(symbols.data(), decoded.data(), BENCH_LEN * sizeof(int32_t))) {
+                        printf("ovlq_decode mismatch\n");
+                }
+        }
+}
+
+static void bench_rans() {
+        static const int entropies[] = {1, 4, 8};
+        std::vector<int32_t> symbols(BENCH_LEN), decoded(BENCH_LEN);
+        char name[64];
+        for (int bits : entropies) {
+                gen_symbols(symbols.data(), BENCH_LEN, bits);
+                uint8_t* encoded;
+                ssize_t size = rans_encode(symbols.data(), BENCH_LEN, &encoded);
+                sprintf(name, "rans_decode %d-bit entropy", bits);
+                run(name, BENCH_LEN, sizeof(int32_t), [&]() {
+                        rans_decode(encoded, size, decoded.data());
+                });
+                scratch_free(encoded);
+                if (memcmp(symbols.data(), decoded.data(), BENCH_LEN * sizeof(int32_t))) {
+                        printf("rans_decode mismatch\n");
+                }
+        }
+}
+
+static void bench_pfor() {
+        static const int entropies[] = {1, 4, 8, 16};
+        std::vector<int32_t> symbols(BENCH_LEN), decoded(BENCH_LEN);
+        char name[64];
+        for (int bits : entropies) {
+                gen_symbols(symbols.data(), BENCH_LEN, bits);
+                uint8_t* encoded;
+                ssize_t size = pfor_encode(symbols.data(), BENCH_LEN, &encoded);
+                sprintf(name, "pfor_decode %d-bit entropy", bits);
+                run(name, BENCH_LEN, sizeof(int32_t), [&]() {
+                        pfor_decode(encoded, size, decoded.data());
+                });
+                scratch_free(encoded);
+                if (memcmp(symbols.data(), decoded.data(), BENCH_LEN * sizeof(int32_t))) {
+                        printf("pfor_decode mismatch\n");
+                }
+        }
+}
+
+static void bench_lorenzo() {
+        static const double noises[] = {1e-3, 1e-1};
+        std::vector<double> signal(BENCH_LEN), decoded(BENCH_LEN);
+        std::vector<int32_t> delta(BENCH_LEN);
+        char name[64];
+        for (double noise : noises) {
+                gen_signal(signal.data(), BENCH_LEN, noise);
+                ArenaScope scope;
+                // every run reuses the same arena memory for the predictor output
+                ArenaMark mark = arena_mark(arena_bound());
+                uint8_t* predictor_out;
+                ssize_t psize, dlen = 0;
+                sprintf(name, "lorenzo1_diff noise %g", noise);
+                run(name, BENCH_LEN, sizeof(double), [&]() {
+                        arena_rewind(arena_bound(), mark);
+                        dlen = lorenzo1_diff<double>(signal.data(), BENCH_LEN, delta.data(), 1e-3, &predictor_out, &psize);
+                });
+                sprintf(name, "lorenzo1_correct noise %g", noise);
+                run(name, BENCH_LEN, sizeof(double), [&]() {
+                        lorenzo1_correct<double>(delta.data(), dlen, decoded.data(), predictor_out, psize);
+                });
+        }
+}
+
+static void bench_nlms() {
+        static const int orders[] = {16, 32};
+        std::vector<double> signal(BENCH_LEN);
+        gen_signal(signal.data(), BENCH_LEN, 1e-2);
+        char name[64];
+        for (int n : orders) {
+                NLMS_base filter(n, 0.5);
+                sprintf(name, "NLMS_base::adapt n=%d", n);
+                run(name, BENCH_LEN - n, sizeof(double), [&]() {
+                        for (ssize_t i = 0; i + n < BENCH_LEN; i++) {
+                                filter.adapt(signal[i + n], &signal[i]);
+                        }
+                });
+        }
+}
+
+static void bench_elf_beta() {
+        static const int digits[] = {1, 4, 8};
+        std::vector<double> values(BENCH_LEN);
+        char name[64];
+        for (int d : digits) {
+                gen_decimals(values.data(), BENCH_LEN, d);
+                sprintf(name, "getAlphaAndBetaStar %d digits", d);
+                run(name, BENCH_LEN, sizeof(double), [&]() {
+                        int last = __INT32_MAX__;
+                        for (double v : values) {
+                                int* ab = getAlphaAndBetaStar(v, last);
+                                last = ab[1];
+                                delete [] ab;
+                        }
+                        sink = last;
+                });
+        }
+}
+
+static void bench_elf_encode() {
+        static const int digits[] = {1, 4, 8};
+        static const struct {
+                const char* name;
+                int digits;
+        } modes[] = {
+                {"per value", ELF_DIGITS_NONE},
+                {"fixed", ELF_DIGITS_DETECT},
+        };
+        std::vector<double> values(BENCH_LEN);
+        char name[64];
+        for (int d : digits) {
+                gen_decimals(values.data(), BENCH_LEN, d);
+                for (auto& mode : modes) {
+                        sprintf(name, "elf_encode %s %d digits", mode.name, d);
+                        run(name, BENCH_LEN, sizeof(double), [&]() {
+                                uint8_t* encoded;
+                                sink = elf_encode_digits(values.data(), BENCH_LEN, &encoded, mode.digits);
+                                free(encoded);
+                        });
+                }
+        }
+}
+
+static void bench_alp_encode() {
+        static const int digits[] = {1, 4, 8};
+        std::vector<double> values(BENCH_LEN);
+        char name[64];
+        for (int d : digits) {
+                gen_decimals(values.data(), BENCH_LEN, d);
+                sprintf(name, "alp_encode %d digits", d);
+                run(name, BENCH_LEN, sizeof(double), [&]() {
+                        uint8_t* encoded;
+                        sink = alp_encode(values.data(), BENCH_LEN, &encoded, 0);
+                        free(encoded);
+                });
+        }
+}
+
+static void bench_xor_decode() {
+        static const int digits[] = {1, 4, 8};
+        static const struct {
+                const char* name;
+                ssize_t (*encode) (double* in, ssize_t len, uint8_t** out, double error);
+                ssize_t (*decode) (uint8_t* in, ssize_t len, double* out, double error);
+        } codecs[] = {
+                {"gorilla_decode", gorilla_encode, gorilla_decode},
+                {"chimp_decode", chimp_encode, chimp_decode},
+                {"elf_decode", elf_encode, elf_decode},
+                {"alp_decode", alp_encode, alp_decode},
+        };
+        std::vector<double> values(BENCH_LEN), decoded(2 * BENCH_LEN);
+        char name[64];
+        for (int d : digits) {
+                gen_decimals(values.data(), BENCH_LEN, d);
+                for (auto& codec : codecs) {
+                        uint8_t* encoded;
+                        ssize_t size = codec.encode(values.data(), BENCH_LEN, &encoded, 0);
+                        sprintf(name, "%s %d digits", codec.name, d);
+                        run(name, BENCH_LEN, sizeof(double), [&]() {
+                                codec.decode(encoded, size, decoded.data(), 0);
+                        });
+                        free(encoded);
+                        if (memcmp(values.data(), decoded.data(), BENCH_LEN * sizeof(double))) {
+                                printf("%s mismatch\n", codec.name);
+                        }
+                }
+        }
+}
+
+int main(int argc, char** argv) {
+        srand(42);
+        // codec scratch memory comes from an arena, as in compression_test
+        Arena arena;
+        arena_init(&arena);
+        arena_bind(&arena);
+        bench_bitstream();
+        bench_huffman();
+        bench_ovlq();
+        bench_rans();
+        bench_pfor();
+        bench_lorenzo();
+        bench_nlms();
+        bench_elf_beta();
+        bench_elf_encode();
+        bench_alp_encode();
+        bench_xor_decode();
+        arena_bind(NULL);
+        arena_destroy(&arena);
+        return 0;
+}
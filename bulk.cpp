@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bulk.h"
+#include "Arena/Arena.h"
+
+#define BULK_WRITE_BUFFER       (1 << 20)
+
+// Per-worker copy of the block being decoded
+static thread_local std::vector<uint8_t> staging;
+
+// Block b goes to slot b % slots once the writer has emptied it of block b - slots.
+typedef struct {
+        std::atomic<int64_t> turn;      // block the slot may take next
+        std::atomic<int64_t> ready;     // block it holds, -1 while it is being filled
+        uint8_t* data;                  // compressed block, or the decoded values
+        ssize_t size;                   // bytes of data, negative if the block failed
+} BulkSlot;
+
+typedef struct {
+        std::vector<BulkSlot> slots;
+        std::atomic<int64_t> next;      // next block to hand out
+        std::atomic<bool> abort;
+        // the workers and the writer only sleep here when the ring is full or empty
+        std::mutex lock;
+        std::condition_variable changed;
+} BulkPipeline;
+
+typedef struct {
+        uint8_t* data;
+        ssize_t size;
+} BulkMap;
+
+/**
+ * Maps `path` privately, codecs that scribble on their input only touch their own pages.
+ */
+static int bulk_map(const char* path, BulkMap* map) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                return -1;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        map->size = st.st_size;
+        map->data = NULL;
+        if (map->size > 0) {
+                void* addr = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                map->data = addr == MAP_FAILED ? NULL : (uint8_t*) addr;
+                if (map->data) {
+                        madvise(map->data, map->size, MADV_SEQUENTIAL);
+                }
+        }
+        close(fd);
+        return map->size > 0 && map->data == NULL ? -1 : 0;
+}
+
+static void bulk_unmap(BulkMap* map) {
+        if (map->data) {
+                munmap(map->data, map->size);
+        }
+}
+
+static void bulk_wait(BulkPipeline* pipe, std::atomic<int64_t>& v, int64_t want) {
+        if (v.load(std::memory_order_acquire) == want) {
+                return;
+        }
+        std::unique_lock<std::mutex> guard(pipe->lock);
+        pipe->changed.wait(guard, [&] {
+                return v.load(std::memory_order_acquire) == want || pipe->abort.load();
+        });
+}
+
+static void bulk_notify(BulkPipeline* pipe) {
+        // taking the lock orders the last store before a waiter's predicate check, no wakeup is lost
+        { std::lock_guard<std::mutex> guard(pipe->lock); }
+        pipe->changed.notify_all();
+}
+
+static void bulk_publish(BulkPipeline* pipe, std::atomic<int64_t>& v, int64_t value) {
+        v.store(value, std::memory_order_release);
+        bulk_notify(pipe);
+}
+
+/**
+ * Runs `blocks` blocks through the pipeline: `work(b, slot)` fills a slot on a worker,
+ * `write(b, slot)` empties it on the calling thread in block order and returns < 0 to stop.
+ * Returns the first negative status, or 0.
+ */
+template<typename Work, typename Write>
+static ssize_t bulk_run(ssize_t blocks, int workers, Work work, Write write) {
+        BulkPipeline pipe;
+        workers = workers > 0 ? workers : 1;
+        std::vector<BulkSlot> slots(BULK_SLOTS_PER_WORKER * workers);
+        pipe.slots.swap(slots);
+        for (size_t s = 0; s < pipe.slots.size(); s++) {
+                pipe.slots[s].turn.store(s);
+                pipe.slots[s].ready.store(-1);
+                pipe.slots[s].data = NULL;
+        }
+        pipe.next.store(0);
+        pipe.abort.store(false);
+        int64_t depth = pipe.slots.size();
+
+        std::vector<std::thread> pool;
+        for (int w = 0; w < workers; w++) {
+                pool.emplace_back([&] {
+                        Arena arena;
+                        arena_init(&arena);
+                        arena_bind(&arena);
+                        for (int64_t b; (b = pipe.next.fetch_add(1)) < blocks && !pipe.abort.load(); ) {
+                                BulkSlot& slot = pipe.slots[b % depth];
+                                bulk_wait(&pipe, slot.turn, b);
+                                if (pipe.abort.load()) {
+                                        break;
+                                }
+                                work(b, &slot);
+                                bulk_publish(&pipe, slot.ready, b);
+                        }
+                        arena_bind(NULL);
+                        arena_destroy(&arena);
+                });
+        }
+
+        ssize_t status = 0;
+        for (int64_t b = 0; b < blocks; b++) {
+                BulkSlot& slot = pipe.slots[b % depth];
+                bulk_wait(&pipe, slot.ready, b);
+                status = slot.size < 0 ? slot.size : write(b, &slot);
+                if (status < 0) {
+                        pipe.abort.store(true);
+                        bulk_notify(&pipe);
+                        break;
+                }
+                slot.ready.store(-1);
+                bulk_publish(&pipe, slot.turn, b + depth);
+        }
+        for (std::thread& t : pool) {
+                t.join();
+        }
+        for (BulkSlot& slot : pipe.slots) {
+                free(slot.data);
+        }
+        return status;
+}
+
+ssize_t bulk_compress(const char* in_path, const char* out_path, ssize_t block_len, double error,
+                BulkCompress compress, int workers) {
+        BulkMap map;
+        if (bulk_map(in_path, &map)) {
+                return -1;
+        }
+        FILE* out = fopen(out_path, "wb");
+        if (out == NULL) {
+                bulk_unmap(&map);
+                return -1;
+        }
+        setvbuf(out, NULL, _IOFBF, BULK_WRITE_BUFFER);
+
+        double* values = (double*) map.data;
+        ssize_t len = map.size / sizeof(double);
+        ssize_t blocks = (len + block_len - 1) / block_len;
+        ssize_t total = 0;
+        ssize_t status = bulk_run(blocks, workers,
+                [&](int64_t b, BulkSlot* slot) {
+                        ssize_t n = len - b * block_len < block_len ? len - b * block_len : block_len;
+                        slot->size = compress(values + b * block_len, n, &slot->data, error);
+                        if (slot->size < 0) {
+                                slot->data = NULL;
+                        }
+                },
+                [&](int64_t b, BulkSlot* slot) -> ssize_t {
+                        fwrite(&slot->size, sizeof(slot->size), 1, out);
+                        fwrite(slot->data, 1, slot->size, out);
+                        total += sizeof(slot->size) + slot->size;
+                        free(slot->data);
+                        slot->data = NULL;
+                        return ferror(out) ? -1 : 0;
+                });
+        fclose(out);
+        bulk_unmap(&map);
+        return status < 0 ? status : total;
+}
+
+ssize_t bulk_decompress(const char* in_path, const char* out_path, ssize_t block_len, double error,
+                BulkDecompress decompress, int workers) {
+        BulkMap map;
+        if (bulk_map(in_path, &map)) {
+                return -1;
+        }
+        // the sizes chain the blocks together, only the offsets are read ahead of the workers
+        std::vector<ssize_t> offsets;
+        for (ssize_t pos = 0; pos + (ssize_t) sizeof(ssize_t) <= map.size; ) {
+                ssize_t size;
+                memcpy(&size, map.data + pos, sizeof(size));
+                if (size < 0 || pos + (ssize_t) sizeof(size) + size > map.size) {
+                        bulk_unmap(&map);
+                        return -1;
+                }
+                offsets.push_back(pos);
+                pos += sizeof(size) + size;
+        }
+        FILE* out = fopen(out_path, "wb");
+        if (out == NULL) {
+                bulk_unmap(&map);
+                return -1;
+        }
+        setvbuf(out, NULL, _IOFBF, BULK_WRITE_BUFFER);
+
+        ssize_t total = 0;
+        ssize_t status = bulk_run(offsets.size(), workers,
+                [&](int64_t b, BulkSlot* slot) {
+                        // a slot keeps its value buffer from block to block, twice the block as in the test
+                        if (slot->data == NULL) {
+                                slot->data = (uint8_t*) malloc(2 * block_len * sizeof(double));
+                        }
+                        ssize_t size;
+                        memcpy(&size, map.data + offsets[b], sizeof(size));
+                        // blocks follow each other at any byte, the codecs expect them aligned like a malloc'd one
+                        staging.resize(size);
+                        memcpy(staging.data(), map.data + offsets[b] + sizeof(size), size);
+                        ssize_t n = decompress(staging.data(), size, (double*) slot->data, error);
+                        slot->size = n < 0 ? n : n * sizeof(double);
+                },
+                [&](int64_t b, BulkSlot* slot) -> ssize_t {
+                        fwrite(slot->data, 1, slot->size, out);
+                        total += slot->size / sizeof(double);
+                        return ferror(out) ? -1 : 0;
+                });
+        fclose(out);
+        bulk_unmap(&map);
+        return status < 0 ? status : total;
+}
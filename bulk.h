@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// Bulk compression of whole files of doubles as a three-stage pipeline: the input file is
+// mapped (the reader), `workers` threads take its blocks in turn and compress them, and the
+// calling thread writes them out in order as the block stream of the test
+// (the ssize_t size of every block, then the block). Blocks are handed out through one atomic
+// counter and land in a ring of BULK_SLOTS_PER_WORKER * workers slots that the writer frees,
+// so the memory in flight does not depend on the file size.
+// The codec must be reentrant: every worker binds its own arena, and the zstd contexts, the
+// shuffle buffers and the adaptive cost model are thread_local. The trained zstd dictionaries
+// (zstd_dicts, zstd_cdict in wrapper.cpp) are shared: zstd_dict_train must not run while the
+// workers compress with them.
+
+#define BULK_SLOTS_PER_WORKER   4
+
+typedef ssize_t (*BulkCompress) (double* input, ssize_t len, uint8_t** output, double error);
+typedef ssize_t (*BulkDecompress) (uint8_t* input, ssize_t size, double* output, double error);
+
+/**
+ * Compresses the doubles of `in_path` in blocks of `block_len` values into the block stream `out_path`.
+ * Returns the size of the stream, or a negative value if a file or a block failed.
+ */
+ssize_t bulk_compress(const char* in_path, const char* out_path, ssize_t block_len, double error,
+                BulkCompress compress, int workers);
+
+/**
+ * Decompresses the block stream `in_path`, of blocks of at most `block_len` values, into the doubles of `out_path`.
+ * Returns the number of values, or a negative value if a file or a block failed.
+ */
+ssize_t bulk_decompress(const char* in_path, const char* out_path, ssize_t block_len, double error,
+                BulkDecompress decompress, int workers);
@@ -6,6 +6,7 @@
 #include "chimp.h"
 #include "ChimpDef.h"
 #include "BitStream/BitReader.h"
+#include "Arena/Arena.h"
 
 static const int16_t leadingRep[] = {0, 8, 12, 16, 18, 20, 22, 24};
 
@@ -39,7 +40,8 @@ ssize_t chimp_decode(uint8_t* in, ssize_t len, double* out, double error) {
         int32_t previousValues = PREVIOUS_VALUES;
         int32_t previousValuesLog2 = 31 - __builtin_clz(PREVIOUS_VALUES);
         int32_t initialFill = previousValuesLog2 + 9;
-        int64_t* storedValues = (int64_t*) calloc(sizeof(int64_t), previousValues);
+        ArenaScope scope;
+        int64_t* storedValues = (int64_t*) scratch_calloc(sizeof(int64_t), previousValues);
 
         int64_t delta;
         storedValues[0] = data[0];
@@ -87,6 +89,71 @@ ssize_t chimp_decode(uint8_t* in, ssize_t len, double* out, double error) {
                         break;
                 }
         }
-        free(storedValues);
+        scratch_free(storedValues);
+        return data_len;
+}
+
+ssize_t chimp_decode_float(uint8_t* in, ssize_t len, float* out, double error) {
+        assert((len - 8) % 4 == 0);
+
+        int32_t storedLeadingZeros = INT32_MAX;
+        int32_t storedTrailingZeros = 0;
+        
+        size_t data_len = *(uint32_t*) in;
+        out[0] = *(float*) (in + 4);
+        if (len == 4 + 4) {
+                return data_len;
+        }
+        uint32_t *data = (uint32_t*) out;
+        BitReader reader;
+        initBitReader(&reader, (uint32_t*) (in + 4 + 4), (len - 8) / 4);
+
+        int32_t previousValues = PREVIOUS_VALUES;
+        int32_t previousValuesLog2 = 31 - __builtin_clz(PREVIOUS_VALUES);
+        int32_t initialFill = previousValuesLog2 + 8;
+        ArenaScope scope;
+        uint32_t* storedValues = (uint32_t*) scratch_calloc(sizeof(uint32_t), previousValues);
+
+        uint32_t delta;
+        storedValues[0] = data[0];
+
+        for (int i = 1; i < data_len; i++) {
+                int32_t flag = peek(&reader, 2);
+                uint32_t tmp, fill, index, significantBits;
+                forward(&reader, 2);
+                switch (flag)
+                {
+                case 3:
+                        tmp = peek(&reader, 3);
+                        forward(&reader, 3);
+                        storedLeadingZeros = leadingRep[tmp];
+                        delta = read_long(&reader, 32 - storedLeadingZeros);
+                        data[i] = data[i-1] ^ delta;
+                        break;
+                case 2:
+                        delta = read_long(&reader, 32 - storedLeadingZeros);
+                        data[i] = data[i-1] ^ delta;
+                        break;
+                case 1:
+                        fill = initialFill;
+                        tmp = peek(&reader, fill);
+                        forward(&reader, fill);
+                        fill -= previousValuesLog2;
+                        index = (tmp >> fill) & ((1 << previousValuesLog2) - 1);
+                        fill -= 3;
+                        storedLeadingZeros = leadingRep[(tmp >> fill) & 0x7];
+                        fill -= 5;
+                        significantBits = (tmp >> fill) & 0x1f;
+                        storedTrailingZeros = 32 - significantBits - storedLeadingZeros;
+                        delta = read_long(&reader, significantBits);
+                        data[i] = storedValues[index] ^ (delta << storedTrailingZeros);
+                        break;
+                default:
+                        data[i] = storedValues[read_long(&reader, previousValuesLog2)];
+                        break;
+                }
+                storedValues[i % previousValues] = data[i];
+        }
+        scratch_free(storedValues);
         return data_len;
 }
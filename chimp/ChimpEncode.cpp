@@ -7,6 +7,8 @@
 #include "ChimpDef.h"
 
 #include "BitStream/BitWriter.h"
+#include "Arena/Arena.h"
+#include "Truncate/Truncate.h"
 
 static const uint16_t leadingRep[] = {
         0, 0, 0, 0, 0, 0, 0, 0,
@@ -40,8 +42,63 @@ write_long(BitWriter* writer, int64_t data, size_t len) {
         }
 }
 
-ssize_t chimp_encode(double* in, ssize_t len, uint8_t** out, double error) {
+/**
+ * Emits one value: '00' + index when it repeats a stored value, '01' + index + window
+ * when the XOR with the stored value at `previousIndex` has more than `threshold`
+ * trailing zeros, otherwise '10'/'11' + leading zeros against the previous value.
+ * Header and payload share one write_fields whenever they fit in 64 bits.
+ */
+static inline void
+chimp_write_value(BitWriter* writer, int64_t delta, int32_t previousIndex, int32_t trailingZeros,
+                int32_t* storedLeadingZeros) {
+        const uint64_t previousValuesLog2 = 31 - __builtin_clz(PREVIOUS_VALUES);
+        const int32_t threshold = 6 + previousValuesLog2;
+        const uint64_t flagZeroSize = previousValuesLog2 + 2;
+        const uint64_t flagOneSize = previousValuesLog2 + 11;
+
+        if (delta == 0) {
+                write(writer, previousIndex, flagZeroSize);
+                *storedLeadingZeros = 65;
+                return;
+        }
+
+        uint64_t leadingZeros = leadingRnd[__builtin_clzl(delta)];
+        if (trailingZeros > threshold) {
+                uint64_t significantBits = 64 - leadingZeros - trailingZeros;
+                uint64_t header = ((PREVIOUS_VALUES + previousIndex) << 9) |
+                        (leadingRep[leadingZeros] << 6) | significantBits;
+                if (flagOneSize + significantBits <= 64) {
+                        write_fields<2>(writer, {{header, flagOneSize}, {(uint64_t) delta >> trailingZeros, significantBits}});
+                } else {
+                        write(writer, header, flagOneSize);
+                        write_long(writer, delta >> trailingZeros, significantBits);
+                }
+                *storedLeadingZeros = 65;
+                return;
+        }
+
+        BitField flag = {2, 2};
+        if ((int32_t) leadingZeros != *storedLeadingZeros) {
+                *storedLeadingZeros = leadingZeros;
+                flag = {(uint64_t) (0x3 << 3) | leadingRep[leadingZeros], 5};
+        }
+        uint64_t significantBits = 64 - leadingZeros;
+        if (flag.len + significantBits <= 64) {
+                write_fields<2>(writer, {flag, {(uint64_t) delta, significantBits}});
+        } else {
+                write(writer, flag.code, flag.len);
+                write_long(writer, delta, significantBits);
+        }
+}
+
+/**
+ * chimp_encode keying every value on its bits from `keyShift` up. The decoder reads the
+ * reference index from the stream, so the key is the encoder's choice: the lossy mode
+ * keys above the truncated bits, which are zero in every value.
+ */
+static ssize_t chimp_encode_keyed(double* in, ssize_t len, uint8_t** out, int32_t keyShift) {
         assert(len > 0);
+        ArenaScope scope;
 
         size_t buffer_size = SIZE_IN_BIT((1 + 1 + 5 + 6 + 64) * len) * 4; 
         *out = (uint8_t*) malloc(4 + buffer_size);
@@ -56,25 +113,18 @@ ssize_t chimp_encode(double* in, ssize_t len, uint8_t** out, double error) {
         int32_t index = 0;
         int32_t current = 0;
 
-        size_t size = 0;
         int32_t previousValues = PREVIOUS_VALUES;
         int32_t previousValuesLog2 = 31 - __builtin_clz(PREVIOUS_VALUES);
         int32_t threshold = 6 + previousValuesLog2;
         int32_t setLsb = (1 << (threshold + 1)) - 1;
-        int32_t* indices = (int32_t*) calloc(sizeof(int32_t), (1 << (threshold + 1)));
-        int64_t* storedValues = (int64_t*) calloc(sizeof(int64_t), PREVIOUS_VALUES);
-        int32_t flagZeroSize = previousValuesLog2 + 2;
-        int32_t flagOneSize = previousValuesLog2 + 11;
+        int32_t* indices = (int32_t*) scratch_calloc(sizeof(int32_t), (1 << (threshold + 1)));
+        int64_t* storedValues = (int64_t*) scratch_calloc(sizeof(int64_t), PREVIOUS_VALUES);
 
         storedValues[current] = data[0];
-        indices[((int) in[0]) & setLsb] = index;
-        size += 64;
+        indices[(int) (data[0] >> keyShift) & setLsb] = index;
 
         for (int i = 1; i < len; i++) {
-                // if (i == 417) {
-                //         asm("nop");
-                // }
-                int32_t key = (int) data[i] & setLsb;
+                int32_t key = (int) (data[i] >> keyShift) & setLsb;
                 int64_t delta;
                 int32_t previousIndex;
                 int32_t trailingZeros = 0;
@@ -87,39 +137,225 @@ ssize_t chimp_encode(double* in, ssize_t len, uint8_t** out, double error) {
                         } else {
                                 previousIndex = index % previousValues;
                                 delta = storedValues[previousIndex] ^ data[i];
+                                trailingZeros = delta ? __builtin_ctzl(delta) : 64;
                         }
                 } else {
+                        // the previous value may also be coded by its trailing zeros
                         previousIndex = index % previousValues;
                         delta = storedValues[previousIndex] ^ data[i];
+                        trailingZeros = delta ? __builtin_ctzl(delta) : 64;
                 }
 
+                chimp_write_value(&writer, delta, previousIndex, trailingZeros, &storedLeadingZeros);
+                current = (current + 1) % previousValues;
+                storedValues[current] = data[i];
+                index++;
+                indices[key] = index;
+        }
+
+        scratch_free(indices);
+        scratch_free(storedValues);
+        return flush(&writer) * 4 + 4 + 8;
+}
+
+ssize_t chimp_encode(double* in, ssize_t len, uint8_t** out, double error) {
+        return chimp_encode_keyed(in, len, out, 0);
+}
+
+#define CHIMP_MAX_WAYS (1 << CHIMP_LEVEL_MAX)
+
+/**
+ * Same bit stream as chimp_encode, but every key keeps a bucket of the `ways` latest
+ * indices. All of them (and the previous value) are XORed with the current value and
+ * the one with the shortest code is used as the reference.
+ */
+static ssize_t chimp_encode_search(double* in, ssize_t len, uint8_t** out, int ways) {
+        ArenaScope scope;
+
+        size_t buffer_size = SIZE_IN_BIT((1 + 1 + 5 + 6 + 64) * len) * 4; 
+        *out = (uint8_t*) malloc(4 + buffer_size);
+        *(uint32_t*) *out = len;
+        *(double*) (*out + 4) = in[0];
+        BitWriter writer;
+        initBitWriter(&writer, (uint32_t*) (*out+4+8), buffer_size / 4 - 2);
+        int64_t *data = (int64_t*) in;
+
+        int32_t storedLeadingZeros = INT32_MAX;
+
+        int32_t index = 0;
+        int32_t current = 0;
+
+        int32_t previousValues = PREVIOUS_VALUES;
+        int32_t previousValuesLog2 = 31 - __builtin_clz(PREVIOUS_VALUES);
+        int32_t threshold = 6 + previousValuesLog2;
+        int32_t setLsb = (1 << (threshold + 1)) - 1;
+        int32_t* buckets = (int32_t*) scratch_calloc(sizeof(int32_t) * ways, (1 << (threshold + 1)));
+        int64_t* storedValues = (int64_t*) scratch_calloc(sizeof(int64_t), PREVIOUS_VALUES);
+        int32_t flagZeroSize = previousValuesLog2 + 2;
+        int32_t flagOneSize = previousValuesLog2 + 11;
+
+        storedValues[current] = data[0];
+        buckets[(data[0] & setLsb) * ways] = index;
+
+        for (int i = 1; i < len; i++) {
+                int32_t* bucket = buckets + (data[i] & setLsb) * ways;
+                int64_t deltas[CHIMP_MAX_WAYS];
+                for (int w = 0; w < ways; w++) {
+                        deltas[w] = data[i] ^ storedValues[bucket[w] % previousValues];
+                }
+
+                // the previous value is always a candidate, through either form
+                int32_t previousIndex = index % previousValues;
+                int64_t delta = storedValues[previousIndex] ^ data[i];
+                int32_t trailingZeros = delta == 0 ? 64 : __builtin_ctzl(delta);
+                int32_t cost;
+                if (delta == 0) {
+                        cost = flagZeroSize;
+                } else if (trailingZeros > threshold) {
+                        cost = flagOneSize + 64 - leadingRnd[__builtin_clzl(delta)] - trailingZeros;
+                } else {
+                        cost = 2 + 64 - leadingRnd[__builtin_clzl(delta)];
+                        trailingZeros = 0;
+                }
+                for (int w = 0; w < ways && cost > flagZeroSize; w++) {
+                        if (index - bucket[w] >= previousValues) {
+                                continue;
+                        }
+                        int32_t tz = deltas[w] == 0 ? 64 : __builtin_ctzl(deltas[w]);
+                        if (tz <= threshold) {
+                                continue;
+                        }
+                        int32_t c = deltas[w] == 0 ? flagZeroSize
+                                : flagOneSize + 64 - leadingRnd[__builtin_clzl(deltas[w])] - tz;
+                        if (c < cost) {
+                                cost = c;
+                                delta = deltas[w];
+                                trailingZeros = tz;
+                                previousIndex = bucket[w] % previousValues;
+                        }
+                }
+
+                chimp_write_value(&writer, delta, previousIndex, trailingZeros, &storedLeadingZeros);
+                current = (current + 1) % previousValues;
+                storedValues[current] = data[i];
+                index++;
+                for (int w = ways - 1; w > 0; w--) {
+                        bucket[w] = bucket[w-1];
+                }
+                bucket[0] = index;
+        }
+
+        scratch_free(buckets);
+        scratch_free(storedValues);
+        return flush(&writer) * 4 + 4 + 8;
+}
+
+ssize_t chimp_encode_level(double* in, ssize_t len, uint8_t** out, int level) {
+        assert(len > 0);
+        if (level <= CHIMP_LEVEL_FAST) {
+                return chimp_encode(in, len, out, 0);
+        }
+        level = level > CHIMP_LEVEL_MAX ? CHIMP_LEVEL_MAX : level;
+        return chimp_encode_search(in, len, out, 1 << level);
+}
+
+ssize_t chimp_encode_lossy(double* in, ssize_t len, uint8_t** out, double error) {
+        ArenaScope scope;
+        double* truncated = (double*) scratch_alloc(len * sizeof(double));
+        truncate_mantissa(in, len, truncated, error);
+        // key on the bits above the fewest bits cleared in a value, at most 64 - key bits
+        int32_t keyShift = 64 - (7 + 31 - __builtin_clz(PREVIOUS_VALUES));
+        int64_t* data = (int64_t*) truncated;
+        for (ssize_t i = 0; i < len; i++) {
+                if ((data[i] << 1) != 0) {
+                        int32_t tz = __builtin_ctzl(data[i]);
+                        keyShift = tz < keyShift ? tz : keyShift;
+                }
+        }
+        ssize_t size = chimp_encode_keyed(truncated, len, out, keyShift);
+        // a series whose exact values repeat (prices, counters) may code better untruncated,
+        // the lossless stream is within any error bound
+        uint8_t* lossless;
+        ssize_t lossless_size = chimp_encode_keyed(in, len, &lossless, 0);
+        if (lossless_size <= size) {
+                free(*out);
+                *out = lossless;
+                size = lossless_size;
+        } else {
+                free(lossless);
+        }
+        scratch_free(truncated);
+        return size;
+}
+
+
+ssize_t chimp_encode_float(float* in, ssize_t len, uint8_t** out, double error) {
+        assert(len > 0);
+        ArenaScope scope;
+
+        size_t buffer_size = SIZE_IN_BIT((1 + 1 + 5 + 5 + 32) * len) * 4; 
+        *out = (uint8_t*) malloc(4 + 4 + buffer_size);
+        *(uint32_t*) *out = len;
+        *(float*) (*out + 4) = in[0];
+        BitWriter writer;
+        initBitWriter(&writer, (uint32_t*) (*out+4+4), buffer_size / 4);
+        uint32_t *data = (uint32_t*) in;
+
+        int32_t storedLeadingZeros = INT32_MAX;
+
+        int32_t index = 0;
+        int32_t current = 0;
+
+        int32_t previousValues = PREVIOUS_VALUES;
+        int32_t previousValuesLog2 = 31 - __builtin_clz(PREVIOUS_VALUES);
+        int32_t threshold = 5 + previousValuesLog2;
+        int32_t setLsb = (1 << (threshold + 1)) - 1;
+        int32_t* indices = (int32_t*) scratch_calloc(sizeof(int32_t), (1 << (threshold + 1)));
+        uint32_t* storedValues = (uint32_t*) scratch_calloc(sizeof(uint32_t), PREVIOUS_VALUES);
+        int32_t flagZeroSize = previousValuesLog2 + 2;
+        int32_t flagOneSize = previousValuesLog2 + 10;
+
+        storedValues[current] = data[0];
+        indices[data[0] & setLsb] = index;
+
+        for (int i = 1; i < len; i++) {
+                int32_t key = data[i] & setLsb;
+                uint32_t delta;
+                int32_t previousIndex;
+                int32_t trailingZeros = 0;
+                int32_t currIndex = indices[key];
+                if ((index - currIndex) < previousValues) {
+                        delta = data[i] ^ storedValues[currIndex % previousValues];
+                        trailingZeros = delta == 0 ? 32 : __builtin_ctz(delta);
+                        if (trailingZeros > threshold) {
+                                previousIndex = currIndex % previousValues;
+                        } else {
+                                previousIndex = index % previousValues;
+                                delta = storedValues[previousIndex] ^ data[i];
+                        }
+                } else {
+                        previousIndex = index % previousValues;
+                        delta = storedValues[previousIndex] ^ data[i];
+                }
+
+                // at most flagOneSize + 32 bits, always a single write_fields
                 if (delta == 0) {
                         write(&writer, previousIndex, flagZeroSize);
-                        size += flagZeroSize;
-                        storedLeadingZeros = 65;
+                        storedLeadingZeros = 33;
                 } else {
-                        int32_t leadingZeros = leadingRnd[__builtin_clzl(delta)];
+                        uint64_t leadingZeros = leadingRnd[__builtin_clz(delta)];
 
                         if (trailingZeros > threshold) {
-                                int32_t significantBits = 64 - leadingZeros - trailingZeros;
-                                write(&writer, ((previousValues + previousIndex) << 9) | 
-                                        (leadingRep[leadingZeros] << 6) |
-                                        significantBits, flagOneSize );
-
-                                write_long(&writer, delta >> trailingZeros, significantBits);
-                                size += significantBits + flagOneSize;
-                                storedLeadingZeros = 65;
-                        } else if (leadingZeros == storedLeadingZeros) {
-                                write(&writer, 2, 2);
-                                int32_t significantBits = 64 - leadingZeros;
-                                write_long(&writer, delta, significantBits);
-                                size += 2 + significantBits;
+                                uint64_t significantBits = 32 - leadingZeros - trailingZeros;
+                                uint64_t header = ((previousValues + previousIndex) << 8) |
+                                        (leadingRep[leadingZeros] << 5) | significantBits;
+                                write_fields<2>(&writer, {{header, (uint64_t) flagOneSize}, {delta >> trailingZeros, significantBits}});
+                                storedLeadingZeros = 33;
+                        } else if ((int32_t) leadingZeros == storedLeadingZeros) {
+                                write_fields<2>(&writer, {{2, 2}, {delta, 32 - leadingZeros}});
                         } else {
                                 storedLeadingZeros = leadingZeros;
-                                int significantBits = 64 - leadingZeros;
-                                write(&writer, (0x3 << 3) | leadingRep[leadingZeros], 5);
-                                write_long(&writer, delta, significantBits);
-                                size += 5 + significantBits;
+                                write_fields<2>(&writer, {{(uint64_t) (0x3 << 3) | leadingRep[leadingZeros], 5}, {delta, 32 - leadingZeros}});
                         }
                 }
                 current = (current + 1) % previousValues;
@@ -128,8 +364,7 @@ ssize_t chimp_encode(double* in, ssize_t len, uint8_t** out, double error) {
                 indices[key] = index;
         }
 
-        free(indices);
-        free(storedValues);
-        return flush(&writer) * 4 + 4 + 8;
-};
-
+        scratch_free(indices);
+        scratch_free(storedValues);
+        return flush(&writer) * 4 + 4 + 4;
+}
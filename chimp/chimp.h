@@ -10,6 +10,24 @@ extern "C" {
 ssize_t chimp_encode(double* in, ssize_t len, uint8_t** out, double error);
 ssize_t chimp_decode(uint8_t* in, ssize_t len, double* out, double error);
 
+// Reference search level. CHIMP_LEVEL_FAST (what chimp_encode uses) keys every value on
+// its low bits and only tries the latest value with the same key; level n keeps the 2^n
+// latest values per key and picks the cheapest reference among them and the previous
+// value. Every level is decoded by chimp_decode.
+#define CHIMP_LEVEL_FAST        0
+#define CHIMP_LEVEL_MAX         3
+
+ssize_t chimp_encode_level(double* in, ssize_t len, uint8_t** out, int level);
+
+// Lossy mode: the low mantissa bits within `error` are cleared first (inc/Truncate/Truncate.h)
+// and the values are keyed on the bits above them; the lossless stream is kept when it is
+// not larger. The stream is decoded by chimp_decode.
+ssize_t chimp_encode_lossy(double* in, ssize_t len, uint8_t** out, double error);
+
+// Single-precision variant (32-bit XORs, 5-bit significant-bit counts).
+ssize_t chimp_encode_float(float* in, ssize_t len, uint8_t** out, double error);
+ssize_t chimp_decode_float(uint8_t* in, ssize_t len, float* out, double error);
+
 #ifdef __cplusplus
 }
 #endif 
\ No newline at end of file
@@ -3,6 +3,11 @@
 #include <string>
 #include <time.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <vector>
+#include <math.h>
+#include <mutex>
+#include <omp.h>
 
 #include "machete/machete.h"
 #include "lfzip/lfzip.h"
@@ -10,11 +15,17 @@
 #include "gorilla/gorilla.h"
 #include "chimp/chimp.h"
 #include "elf/elf.h"
+#include "alp/alp.h"
+#include "adaptive.h"
+#include "wrapper.h"
+#include "bulk.h"
+#include "Shuffle/Shuffle.h"
+#include "ZoneMap/ZoneMap.h"
+#include "Pyramid/Pyramid.h"
+#include "Arena/Arena.h"
+#include "PerfEvent/PerfEvent.h"
+#include "Synthetic/Synthetic.h"
 
-ssize_t zlib_compress   (double* in, ssize_t len, uint8_t** out, double error);
-ssize_t zlib_decompress (uint8_t* in, ssize_t len, double* out, double error);
-ssize_t zstd_compress   (double* in, ssize_t len, uint8_t** out, double error);
-ssize_t zstd_decompress (uint8_t* in, ssize_t len, double* out, double error);
 
 enum ListError {
         SKIP = -2,
@@ -22,20 +33,39 @@ enum ListError {
 };
 
 enum Type {Lossy, Lossless};
+// Trailer appended to the blocks of a compressor, checked by the test
+enum Trailer {Plain, Zones, Pyramid};
 
 typedef struct {
         ssize_t ori_size;
         ssize_t cmp_size;
         ssize_t cmp_time;
         ssize_t dec_time;
+        // hardware counters, only filled when collect_counters is set
+        PerfCounts cmp_events;
+        PerfCounts dec_events;
 } Perf;
 
 Perf empty = {0,0,0,0};
 
+// Files of a dataset, defined after the dataset list
+static std::vector<std::string> dataset_files(int ds);
+static FILE* dataset_open(int ds, const std::string& file);
+static bool held_out(int ds, size_t file);
+static FILE* held_out_open(int ds, const std::string& file, size_t index);
+
 static inline ssize_t machete_decompress_lorenzo1_hybrid(uint8_t* input , ssize_t size, double* output, double error) {
         return machete_decompress<lorenzo1,hybrid>(input, size, output);
 }
 
+static inline ssize_t machete_decompress_lorenzo1_rans(uint8_t* input , ssize_t size, double* output, double error) {
+        return machete_decompress<lorenzo1,rans>(input, size, output);
+}
+
+static inline ssize_t machete_decompress_lorenzo1_pfor(uint8_t* input , ssize_t size, double* output, double error) {
+        return machete_decompress<lorenzo1,pfor>(input, size, output);
+}
+
 static inline ssize_t SZ_compress_wrapper(double* input, ssize_t len, uint8_t** output, double error) {
         return SZ_compress(input, len, output, error);
 }
@@ -44,6 +74,77 @@ static inline ssize_t SZ_decompress_wrapper(uint8_t* input , ssize_t size, doubl
         return SZ_decompress(input, size, output, error);
 }
 
+#define DICT_SIZE               (16 * 1024)
+#define DICT_BLOCKS_PER_FILE    32
+
+// Sample up to DICT_BLOCKS_PER_FILE evenly spaced blocks of every held-out file of dataset `ds`
+// (see held_out_open) and train the zstd dictionary on them, so it is never tested on its own samples.
+static void zstd_dict_train_wrapper(int ds, int chunk_size) {
+        std::vector<double> samples;
+        std::vector<size_t> block_lens;
+        std::vector<std::string> files = dataset_files(ds);
+        for (size_t f = 0; f < files.size(); f++) {
+                FILE* file = held_out_open(ds, files[f], f);
+                if (file == NULL) {
+                        continue;
+                }
+                fseek(file, 0, SEEK_END);
+                ssize_t blocks = ftell(file) / sizeof(double) / chunk_size;
+                ssize_t step = blocks > DICT_BLOCKS_PER_FILE ? blocks / DICT_BLOCKS_PER_FILE : 1;
+                for (ssize_t b = 0; b < blocks && b / step < DICT_BLOCKS_PER_FILE; b += step) {
+                        fseek(file, b * chunk_size * sizeof(double), SEEK_SET);
+                        size_t offset = samples.size();
+                        samples.resize(offset + chunk_size);
+                        samples.resize(offset + fread(&samples[offset], sizeof(double), chunk_size, file));
+                        block_lens.push_back(samples.size() - offset);
+                }
+                fclose(file);
+        }
+
+        unsigned id = zstd_dict_train(samples.data(), block_lens.data(), block_lens.size(), DICT_SIZE);
+        printf("zstd dictionary %u trained on %zu blocks\n", id, block_lens.size());
+}
+
+static inline ssize_t machete_compress_float_wrapper(float* input, ssize_t len, uint8_t** output, double error) {
+        return machete_compress_float<lorenzo1, hybrid>(input, len, output, error);
+}
+
+static inline ssize_t machete_decompress_float_wrapper(uint8_t* input, ssize_t size, float* output, double error) {
+        return machete_decompress_float<lorenzo1, hybrid>(input, size, output);
+}
+
+template<int level>
+static inline ssize_t chimp_level_wrapper(double* input, ssize_t len, uint8_t** output, double error) {
+        return chimp_encode_level(input, len, output, level);
+}
+
+template<GeneralCodec codec, int mode>
+static inline ssize_t shuffle_compress_wrapper(double* input, ssize_t len, uint8_t** output, double error) {
+        return shuffle_compress(input, len, output, codec, mode);
+}
+
+template<ZoneMapCompress compress>
+static inline ssize_t zonemap_compress_wrapper(double* input, ssize_t len, uint8_t** output, double error) {
+        return zonemap_compress(input, len, output, error, compress);
+}
+
+template<ZoneMapDecompress decompress>
+static inline ssize_t zonemap_decompress_wrapper(uint8_t* input, ssize_t size, double* output, double error) {
+        return zonemap_decompress(input, size, output, error, decompress);
+}
+
+#define PYRAMID_SPAN    64
+
+template<PyramidCompress compress>
+static inline ssize_t pyramid_compress_wrapper(double* input, ssize_t len, uint8_t** output, double error) {
+        return pyramid_compress(input, len, output, error, compress, PYRAMID_SPAN);
+}
+
+template<PyramidDecompress decompress>
+static inline ssize_t pyramid_decompress_wrapper(uint8_t* input, ssize_t size, double* output, double error) {
+        return pyramid_decompress(input, size, output, error, decompress);
+}
+
 /*********************************************************************
  *                      Evaluation Settings 
 *********************************************************************/
@@ -55,24 +156,58 @@ struct {
         ssize_t (*compress) (double* input, ssize_t len, uint8_t** output, double error);
         ssize_t (*decompress) (uint8_t* input, ssize_t size, double* output, double error);
         Perf perf;
+        // optional training stage run over the dataset before it is tested
+        void (*train) (int ds, int chunk_size);
+        // single-precision codecs leave compress/decompress empty and set these instead,
+        // the data is then narrowed to float and the ratio is against 4-byte values.
+        ssize_t (*compress_f) (float* input, ssize_t len, uint8_t** output, double error);
+        ssize_t (*decompress_f) (uint8_t* input, ssize_t size, float* output, double error);
+        Trailer trailer;
+        // part of every call runs on pooled OpenMP threads, which the counters can't see
+        bool pooled;
 } 
 
 compressors[] = {
         { "Machete",    Type::Lossy,    machete_compress<lorenzo1, hybrid>,     machete_decompress_lorenzo1_hybrid,     empty},
         { "LFZip",      Type::Lossy,    lfzip_compress,                         lfzip_decompress,                       empty},
+        { "LFZip-MT",   Type::Lossy,    lfzip_compress_mt,                      lfzip_decompress_mt,                    empty,  NULL, NULL, NULL, Trailer::Plain, true},
         { "SZ3",        Type::Lossy,    SZ_compress_wrapper,                    SZ_decompress_wrapper,                  empty},
         { "Gorilla",    Type::Lossless, gorilla_encode,                         gorilla_decode,                         empty},
         { "Chimp",      Type::Lossless, chimp_encode,                           chimp_decode,                           empty},
         { "Elf",        Type::Lossless, elf_encode,                             elf_decode,                             empty},
         { "Zlib",       Type::Lossless, zlib_compress,                          zlib_decompress,                        empty},
         { "ZSTD",       Type::Lossless, zstd_compress,                          zstd_decompress,                        empty},
+        { "Adaptive",   Type::Lossy,    adaptive_compress,                      adaptive_decompress,                    empty},
+        { "ZSTD+shuffle",       Type::Lossless, shuffle_compress_wrapper<GENERAL_ZSTD, SHUFFLE_BYTE>,                   shuffle_decompress, empty},
+        { "ZSTD+bitshuffle",    Type::Lossless, shuffle_compress_wrapper<GENERAL_ZSTD, SHUFFLE_BIT>,                    shuffle_decompress, empty},
+        { "ZSTD+xor+shuf",      Type::Lossless, shuffle_compress_wrapper<GENERAL_ZSTD, SHUFFLE_XOR | SHUFFLE_BYTE>,     shuffle_decompress, empty},
+        { "Zlib+shuffle",       Type::Lossless, shuffle_compress_wrapper<GENERAL_ZLIB, SHUFFLE_BYTE>,                   shuffle_decompress, empty},
+        { "BSC+shuffle",        Type::Lossless, shuffle_compress_wrapper<GENERAL_BSC, SHUFFLE_BYTE>,                    shuffle_decompress, empty},
+        { "BSC+delta+shuf",     Type::Lossless, shuffle_compress_wrapper<GENERAL_BSC, SHUFFLE_DELTA | SHUFFLE_BYTE>,    shuffle_decompress, empty},
+        { "ZSTD+dict",  Type::Lossless, zstd_dict_compress,                     zstd_dict_decompress,                   empty,  zstd_dict_train_wrapper},
+        { "Gorilla-f32",        Type::Lossless, NULL, NULL, empty, NULL,        gorilla_encode_float,                   gorilla_decode_float},
+        { "Chimp-f32",          Type::Lossless, NULL, NULL, empty, NULL,        chimp_encode_float,                     chimp_decode_float},
+        { "Elf-f32",            Type::Lossless, NULL, NULL, empty, NULL,        elf_encode_float,                       elf_decode_float},
+        { "Machete-f32",        Type::Lossy,    NULL, NULL, empty, NULL,        machete_compress_float_wrapper,         machete_decompress_float_wrapper},
+        { "Chimp-L3",   Type::Lossless, chimp_level_wrapper<CHIMP_LEVEL_MAX>,   chimp_decode,                           empty},
+        { "ALP",        Type::Lossless, alp_encode,                             alp_decode,                             empty},
+        { "Machete-rANS",       Type::Lossy,    machete_compress<lorenzo1, rans>,       machete_decompress_lorenzo1_rans,       empty},
+        { "Machete-PFor",       Type::Lossy,    machete_compress<lorenzo1, pfor>,       machete_decompress_lorenzo1_pfor,       empty},
+        { "Gorilla-lossy",      Type::Lossy,    gorilla_encode_lossy,                   gorilla_decode,                         empty},
+        { "Chimp-lossy",        Type::Lossy,    chimp_encode_lossy,                     chimp_decode,                           empty},
+        { "Gorilla+zones",      Type::Lossless, zonemap_compress_wrapper<gorilla_encode>,       zonemap_decompress_wrapper<gorilla_decode>,     empty, NULL, NULL, NULL, Trailer::Zones},
+        { "Machete+zones",      Type::Lossy,    zonemap_compress_wrapper<machete_compress<lorenzo1, hybrid>>,   zonemap_decompress_wrapper<machete_decompress_lorenzo1_hybrid>, empty, NULL, NULL, NULL, Trailer::Zones},
+        { "Chimp+pyramid",      Type::Lossless, pyramid_compress_wrapper<chimp_encode>,         pyramid_decompress_wrapper<chimp_decode>,       empty, NULL, NULL, NULL, Trailer::Pyramid},
+        { "Machete+pyramid",    Type::Lossy,    pyramid_compress_wrapper<machete_compress<lorenzo1, hybrid>>,   pyramid_decompress_wrapper<machete_decompress_lorenzo1_hybrid>, empty, NULL, NULL, NULL, Trailer::Pyramid},
 };
 
-// Available datasets
+// Available datasets, a dataset is either a directory of raw double files
+// or a synthetic series generated in memory (path NULL, see inc/Synthetic/Synthetic.h)
 struct {
         char name[16];
         const char* path;
         double error;
+        SynthSpec synth;
 } 
 
 datasets[] = {
@@ -95,17 +230,125 @@ datasets[] = {
         // { "Stock",      "./example_data/stock"     , 5E-3},
         // { "Stock",      "./example_data/stock"     , 1E-3},
         // { "Stock",      "./example_data/stock"     , 5E-4},
+        //                                      kind                    length          digits  noise   seed
+        { "RandomWalk", NULL,   1E-3,   {SYNTH_RANDOM_WALK,     1 << 20,        3,      0.1,    1}},
+        { "Sine",       NULL,   1E-3,   {SYNTH_SINE,            1 << 20,        4,      0.01,   2}},
+        { "Step",       NULL,   1E-2,   {SYNTH_STEP,            1 << 20,        2,      0.05,   3}},
+        { "Counter",    NULL,   1E-1,   {SYNTH_COUNTER,         1 << 20,        0,      2,      4}},
+        { "GPS",        NULL,   1E-6,   {SYNTH_GPS,             1 << 20,        6,      0.5,    5}},
+        { "Price",      NULL,   1E-3,   {SYNTH_PRICE,           1 << 20,        2,      0.001,  6}},
+        { "Constant",   NULL,   1E-3,   {SYNTH_CONSTANT,        1 << 20,        3,      1,      7}},
 };
 
 // List of compressors to be evaluated (use indices in the "compressors" array above)
-int compressor_list[] = {0, 1, 2, 3, 4, 5, 6, 7, EOL};
+int compressor_list[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, EOL};
 // List of datasets to be evaluated (use indices in the "datasets" array above)
 int dataset_list[] = {0, 2, 4, EOL}; 
+// Synthetic datasets do not need ./example_data, use them for reproducible runs:
+// int dataset_list[] = {5, 6, 7, 8, 9, 10, 11, EOL};
 // List of slice lengths to be evaluated
 int bsize_list[] = {500, 1000, 2000, EOL};
+// Compressors also run through the bulk pipeline (bulk.h) over every file of the datasets,
+// with the first slice length and `bulk_workers` compression threads
+int bulk_list[] = {0, 4, EOL};
+int bulk_workers = 4;
+// Count cycles, instructions, branch and cache misses (perf_event_open) of every
+// compress/decompress call; counters the machine lacks are reported as n/a.
+bool collect_counters = true;
+// Threads of the test: the (file, compressor) pairs of a dataset are run as tasks on an OpenMP
+// pool and every thread keeps its own Perf, merged when the dataset is done. With 1 the tasks
+// run in order on the main thread and the times are process CPU time (clock()), otherwise
+// they are the CPU time of the task's thread, which leaves out the helper threads of LFZip-MT.
+int test_workers = 1;
+// Let only one task at a time run a timed compress/decompress call, the rest of the tasks
+// (reading, checking, writing the blocks) still overlaps
+bool serialize_timing = false;
+// Every report is also exported here, NULL to disable
+const char* csv_path = "cmp_product/report.csv";
+const char* json_path = "cmp_product/report.json";
 
 ///////////////////////// Setting End ////////////////////////////
 
+static std::vector<std::string> dataset_files(int ds) {
+        std::vector<std::string> files;
+        if (datasets[ds].path == NULL) {
+                files.push_back(datasets[ds].name);
+                return files;
+        }
+        DIR* dir = opendir(datasets[ds].path);
+        if (dir == NULL) {
+                printf("Cannot open %s\n", datasets[ds].path);
+                return files;
+        }
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+                // prevent processing hidden files and directories ('.' and '..')
+                if (ent->d_name[0] == '.') {
+                        continue;
+                }
+                // This line creates a file path string by combining the dataset path and the file name.
+                files.push_back(std::string(datasets[ds].path) + "/" + ent->d_name);
+        }
+        closedir(dir);
+        return files;
+}
+
+static FILE* dataset_open(int ds, const std::string& file) {
+        if (datasets[ds].path == NULL) {
+                return synth_open(&datasets[ds].synth);
+        }
+        return fopen(file.c_str(), "rb");
+}
+
+/**
+ * Whether file `file` of dataset `ds` is held out to train the compressors with a training
+ * stage, which are then not tested on it: every other file of a directory of two or more.
+ * A directory of one file has none, its dictionary compressors run untrained.
+ */
+static bool held_out(int ds, size_t file) {
+        return datasets[ds].path != NULL && file % 2 == 1;
+}
+
+#define HELD_OUT_SEED_OFFSET    0x9e3779b97f4a7c15ULL
+
+// Open file `index` of dataset `ds` for training, or return NULL if it is tested instead.
+// A synthetic dataset is trained on the same series drawn with another seed.
+static FILE* held_out_open(int ds, const std::string& file, size_t index) {
+        if (datasets[ds].path == NULL) {
+                SynthSpec spec = datasets[ds].synth;
+                spec.seed += HELD_OUT_SEED_OFFSET;
+                return synth_open(&spec);
+        }
+        return held_out(ds, index) ? dataset_open(ds, file) : NULL;
+}
+
+std::mutex timing_lock;
+
+/**
+ * CPU time in clock() units, of the process when the tasks run one by one, of the calling thread otherwise.
+ */
+static inline int64_t cpu_clock() {
+        if (test_workers <= 1) {
+                return clock();
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec * CLOCKS_PER_SEC + ts.tv_nsec / (1000000000 / CLOCKS_PER_SEC);
+}
+
+static void perf_merge(Perf* into, const Perf* from) {
+        into->ori_size += from->ori_size;
+        into->cmp_size += from->cmp_size;
+        into->cmp_time += from->cmp_time;
+        into->dec_time += from->dec_time;
+        for (int i = 0; i < PERF_EV_COUNT; i++) {
+                into->cmp_events.count[i] += from->cmp_events.count[i];
+                into->dec_events.count[i] += from->dec_events.count[i];
+        }
+        into->cmp_events.missing |= from->cmp_events.missing;
+        into->dec_events.missing |= from->dec_events.missing;
+}
+
 
 int check(double *d_org, double *d_cmp, size_t len, double error) {
         if (error == 0) {
@@ -131,9 +374,12 @@ int check(double *d_org, double *d_cmp, size_t len, double error) {
  * Test a single file with a specific compressor.
  * @param file The file to be tested.
  * @param c The index of the compressor in the compressors array.
+ * @param perf Where the sizes, times and counters are added.
+ * @param events The counters of the calling thread.
+ * @param task Tells apart the files of the tasks running at the same time.
  * @return If collation fails, return -1; otherwise, return 0.
  */
-int test_file(FILE* file, int c, int chunk_size, double error) {
+int test_file(FILE* file, int c, int chunk_size, double error, Perf* perf, PerfEvents* events, int task) {
         // d_org is the original data read from the file
         // d_cmp is the compressed data
         // d_dcmp is the decompressed data
@@ -144,13 +390,24 @@ int test_file(FILE* file, int c, int chunk_size, double error) {
         double *d_dcmp = (double*) malloc(2 * chunk_size * sizeof(double));
         int64_t start;
 
+        // single-precision codecs work on a narrowed copy of the data
+        bool single = compressors[c].compress_f != NULL;
+        float *f_org = single ? (float*) malloc(chunk_size * sizeof(float)) : NULL;
+        float *f_dcmp = single ? (float*) malloc(2 * chunk_size * sizeof(float)) : NULL;
+        ssize_t value_size = single ? sizeof(float) : sizeof(double);
+        // a pooled compressor's counts would leave out its helpers, report them as n/a instead
+        PerfEvents none = {{-1, -1, -1, -1, -1}};
+        if (compressors[c].pooled) {
+                events = &none;
+        }
+
         
         // Ensure the "cmp_product" directory exists
         system("mkdir -p cmp_product");
 
         // Save each compressor's compressed data to a unique file
         char cmp_path[257];
-        sprintf(cmp_path, "cmp_product/tmp_%s.cmp", compressors[c].name);
+        sprintf(cmp_path, "cmp_product/tmp_%s_%d.cmp", compressors[c].name, task);
 
         FILE* fc = fopen(cmp_path, "w");
         int block = 0;
@@ -162,10 +419,26 @@ int test_file(FILE* file, int c, int chunk_size, double error) {
                 if (len0 == 0) break;
 
                 // real encoding happens here
-                start = clock();
-                ssize_t len1 = compressors[c].compress(d_org, len0, &d_cmp, error);
-                compressors[c].perf.cmp_time += clock() - start;
-                compressors[c].perf.cmp_size += len1;
+                ssize_t len1;
+                for (int i = 0; single && i < len0; i++) {
+                        f_org[i] = d_org[i];
+                }
+                {
+                        std::unique_lock<std::mutex> timed(timing_lock, std::defer_lock);
+                        if (serialize_timing) {
+                                timed.lock();
+                        }
+                        perf_events_start(events);
+                        start = cpu_clock();
+                        if (single) {
+                                len1 = compressors[c].compress_f(f_org, len0, &d_cmp, error);
+                        } else {
+                                len1 = compressors[c].compress(d_org, len0, &d_cmp, error);
+                        }
+                        perf->cmp_time += cpu_clock() - start;
+                        perf_events_stop(events, &perf->cmp_events);
+                }
+                perf->cmp_size += len1;
                 
                 // `fwrite` writes the data that the pointer points to
                 // so you should pass the pointer, the size of the elem of data
@@ -196,10 +469,32 @@ int test_file(FILE* file, int c, int chunk_size, double error) {
                 (void)!fread(d_cmp, 1, len1, fc);
 
                 // real decoding happens here
-                start = clock();
-                ssize_t len2 = compressors[c].decompress(d_cmp, len1, d_dcmp, error);
-                compressors[c].perf.dec_time += clock() - start;
-                compressors[c].perf.ori_size += len2 * sizeof(double);
+                ssize_t len2;
+                {
+                        std::unique_lock<std::mutex> timed(timing_lock, std::defer_lock);
+                        if (serialize_timing) {
+                                timed.lock();
+                        }
+                        perf_events_start(events);
+                        start = cpu_clock();
+                        if (single) {
+                                len2 = compressors[c].decompress_f(d_cmp, len1, f_dcmp, error);
+                        } else {
+                                len2 = compressors[c].decompress(d_cmp, len1, d_dcmp, error);
+                        }
+                        perf->dec_time += cpu_clock() - start;
+                        perf_events_stop(events, &perf->dec_events);
+                }
+                if (single) {
+                        // compare against the float the codec was given
+                        for (int i = 0; i < len0; i++) {
+                                d_org[i] = (float) d_org[i];
+                        }
+                        for (int i = 0; i < len2; i++) {
+                                d_dcmp[i] = f_dcmp[i];
+                        }
+                }
+                perf->ori_size += len2 * value_size;
 
                 double terror;
                 switch (compressors[c].type) {
@@ -207,12 +502,49 @@ int test_file(FILE* file, int c, int chunk_size, double error) {
                         case Lossless: terror = 0; break;
                 }
 
-                if (len0 != len2 || check(d_org, d_dcmp, len0, terror)) {
+                // the zone map of a block must describe the values it was given
+                ZoneMap stats;
+                bool stats_ok = true;
+                if (compressors[c].trailer == Trailer::Zones) {
+                        ZoneMap expected;
+                        zonemap_scan(d_org, len0, &expected);
+                        if (!block_stats(d_cmp, len1, &stats)) {
+                                printf("Zone map missing\n");
+                                stats_ok = false;
+                        } else if (memcmp(&stats, &expected, sizeof(ZoneMap))) {
+                                printf("Zone map mismatch: [%lf, %lf] sum %lf count %ld\n", stats.min, stats.max, stats.sum, stats.count);
+                                stats_ok = false;
+                        }
+                }
+
+                // so must the finest level of its pyramid
+                std::vector<PyramidBucket> buckets(len0);
+                ssize_t span;
+                ssize_t bucket_cnt = 0;
+                if (compressors[c].trailer == Trailer::Pyramid) {
+                        bucket_cnt = pyramid_read(d_cmp, len1, len0, buckets.data(), &span);
+                        if (bucket_cnt <= 0) {
+                                printf("Pyramid missing\n");
+                                stats_ok = false;
+                        }
+                }
+                for (ssize_t b = 0; b < bucket_cnt && stats_ok; b++) {
+                        ssize_t end = std::min<ssize_t>((b + 1) * span, len0);
+                        stats_ok = buckets[b].first == (float) d_org[b * span] && buckets[b].last == (float) d_org[end - 1];
+                        for (ssize_t i = b * span; i < end; i++) {
+                                stats_ok &= !(d_org[i] < buckets[b].min || d_org[i] > buckets[b].max);
+                        }
+                        if (!stats_ok) {
+                                printf("Pyramid mismatch in bucket %ld: [%f, %f]\n", b, buckets[b].min, buckets[b].max);
+                        }
+                }
+
+                if (len0 != len2 || !stats_ok || check(d_org, d_dcmp, len0, terror)) {
                         // we give more specific name to the dump file
                         // so that we can identify which compressor and block caused the error
                         system("mkdir -p dump");
                         char dump_path[257];
-                        sprintf(dump_path, "dump/problem_%s_%d.data", compressors[c].name, block);
+                        sprintf(dump_path, "dump/problem_%s_%d_%d.data", compressors[c].name, task, block);
                         printf("Check failed, dumping data to dump_path\n");
 
                         FILE* dump = fopen(dump_path, "w");
@@ -221,15 +553,78 @@ int test_file(FILE* file, int c, int chunk_size, double error) {
 
                         free(d_cmp); free(d_dcmp);
                         free(d_org); fclose(fc);
+                        free(f_org); free(f_dcmp);
                         return -1;
                 }
                 free(d_cmp);
                 block++;
         }
         fclose(fc);
+        // a failed task keeps its blocks next to the dump
+        unlink(cmp_path);
 
         free(d_org);
         free(d_dcmp);
+        free(f_org);
+        free(f_dcmp);
+        return 0;
+}
+
+static double wall_seconds() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Compresses and decompresses every file of dataset `ds` through the bulk pipeline and
+ * checks the result, reporting the wall-clock throughput of both directions.
+ */
+int test_bulk(int ds, int c, int chunk_size) {
+        if (datasets[ds].path == NULL) {
+                return 0;
+        }
+        double error = compressors[c].type == Lossy ? datasets[ds].error : 0;
+        char cmp_path[257], out_path[257];
+        sprintf(cmp_path, "cmp_product/bulk_%s.cmp", compressors[c].name);
+        sprintf(out_path, "cmp_product/bulk_%s.out", compressors[c].name);
+        ssize_t ori_size = 0, cmp_size = 0;
+        double cmp_time = 0, dec_time = 0;
+        for (const std::string& path : dataset_files(ds)) {
+                double start = wall_seconds();
+                ssize_t size = bulk_compress(path.c_str(), cmp_path, chunk_size, datasets[ds].error, compressors[c].compress, bulk_workers);
+                cmp_time += wall_seconds() - start;
+                start = wall_seconds();
+                ssize_t len = size < 0 ? size : bulk_decompress(cmp_path, out_path, chunk_size, datasets[ds].error, compressors[c].decompress, bulk_workers);
+                dec_time += wall_seconds() - start;
+                if (len < 0) {
+                        printf("Bulk %s failed on %s\n", compressors[c].name, path.c_str());
+                        return -1;
+                }
+
+                FILE* org = fopen(path.c_str(), "rb");
+                FILE* dcmp = fopen(out_path, "rb");
+                std::vector<double> d_org(chunk_size), d_dcmp(chunk_size);
+                ssize_t checked = 0;
+                for (ssize_t n; (n = fread(d_org.data(), sizeof(double), chunk_size, org)) > 0; checked += n) {
+                        if (fread(d_dcmp.data(), sizeof(double), n, dcmp) != (size_t) n || check(d_org.data(), d_dcmp.data(), n, error)) {
+                                break;
+                        }
+                }
+                fclose(org);
+                fclose(dcmp);
+                if (checked != len) {
+                        printf("Bulk %s mismatch on %s\n", compressors[c].name, path.c_str());
+                        return -1;
+                }
+                ori_size += len * sizeof(double);
+                cmp_size += size;
+        }
+        unlink(cmp_path);
+        unlink(out_path);
+        printf("Bulk %s (%d workers): ratio %lf, compression %lf MB/s, decompression %lf MB/s\n",
+                compressors[c].name, bulk_workers, (double) ori_size / cmp_size,
+                ori_size / 1024.0 / 1024 / cmp_time, ori_size / 1024.0 / 1024 / dec_time);
         return 0;
 }
 
@@ -255,57 +650,127 @@ int test_dataset(int ds, int chunk_size) {
         printf("**************************************\n");
         fflush(stdout); // Ensure the print message appears immediately.
 
-        DIR* dir = opendir(datasets[ds].path);
-        char filepath[257];
-        struct dirent *ent;
-        
-        // Count the number of files in the directory
-        int file_cnt = 0;
-        while ((ent = readdir(dir)) != NULL) {
-                // DT_REG indicates that a directory entry is a regular file.
-                if (ent->d_type == DT_REG) {
-                        file_cnt++;
+        std::vector<std::string> files = dataset_files(ds);
+        int file_cnt = files.size();
+        if (file_cnt == 0) {
+                return -1;
+        }
+
+        // Compressors with a training stage (e.g. zstd dictionaries) sample the dataset first.
+        for (int i = 0; compressor_list[i] != EOL; i++) {
+                if (compressor_list[i] != SKIP && compressors[compressor_list[i]].train) {
+                        compressors[compressor_list[i]].train(ds, chunk_size);
                 }
         }
         
-        // readdir(dir) will move the directory pointer, so we need to rewind it.
-        rewinddir(dir);
-        
-        int cur_file = 0;
-        draw_progress(cur_file, file_cnt, 80);
-        while ((ent = readdir(dir)) != NULL) {
-                // prevent processing hidden files and directories ('.' and '..')
-                if (ent->d_name[0] == '.') {
-                        continue;
+        // task t tests file t / list_len with compressor_list[t % list_len]
+        int list_len = 0;
+        while (compressor_list[list_len] != EOL) {
+                list_len++;
+        }
+        int workers = test_workers > 1 ? test_workers : 1;
+        std::vector<std::vector<Perf>> thread_perf(workers, std::vector<Perf>(list_len, empty));
+        std::vector<char> failed(list_len, 0);
+        int done = 0;
+        draw_progress(done, file_cnt * list_len, 80);
+        #pragma omp parallel num_threads(workers)
+        {
+                // counters only count the thread that opened them and the threads it creates
+                PerfEvents events = {{-1, -1, -1, -1, -1}};
+                if (collect_counters) {
+                        perf_events_open(&events);
                 }
-                // This line creates a file path string by combining the dataset path and the file name.
-                sprintf(filepath, "%s/%s", datasets[ds].path, ent->d_name);
-                
-                // the result is stored in `filepath` buffer for later use. (e.g., opening the file)
-                FILE* file = fopen(filepath, "rb");
-                for (int i = 0; compressor_list[i] != EOL; i++) {
-                        if (compressor_list[i] == SKIP) {
-                                continue;
-                        }
-                        // ensure the file pointer is at the beginning of the file
-                        fseek(file, 0, SEEK_SET);
-
-                        // In C, any non-zero (e.g. -1 -> true) value is considered true in an if condition.
-                        if (test_file(file, compressor_list[i], chunk_size, datasets[ds].error)) {
-                                printf("Error Occurred while testing %s, skipping\n", compressors[compressor_list[i]].name);
-                                compressor_list[i] = SKIP;
+                // the main thread keeps its arena, the others get one for the region
+                Arena worker_arena;
+                arena_init(&worker_arena);
+                Arena* prev = arena_bind(arena_bound() ? arena_bound() : &worker_arena);
+                std::vector<Perf>& perf = thread_perf[omp_get_thread_num()];
+
+                #pragma omp for schedule(dynamic, 1)
+                for (int t = 0; t < file_cnt * list_len; t++) {
+                        int i = t % list_len;
+                        int c = compressor_list[i];
+                        bool skip;
+                        #pragma omp atomic read
+                        skip = failed[i];
+                        if (c != SKIP && !skip && !(compressors[c].train && held_out(ds, t / list_len))) {
+                                FILE* file = dataset_open(ds, files[t / list_len]);
+                                // In C, any non-zero (e.g. -1 -> true) value is considered true in an if condition.
+                                if (test_file(file, c, chunk_size, datasets[ds].error, &perf[i], &events, t)) {
+                                        printf("Error Occurred while testing %s, skipping\n", compressors[c].name);
+                                        #pragma omp atomic write
+                                        failed[i] = 1;
+                                }
+                                fclose(file);
                         }
+                        #pragma omp critical
+                        draw_progress(++done, file_cnt * list_len, 80);
+                }
+                arena_bind(prev);
+                arena_destroy(&worker_arena);
+                perf_events_close(&events);
+        }
+        for (int i = 0; i < list_len; i++) {
+                if (failed[i]) {
+                        compressor_list[i] = SKIP;
+                }
+                for (int w = 0; compressor_list[i] != SKIP && w < workers; w++) {
+                        perf_merge(&compressors[compressor_list[i]].perf, &thread_perf[w][i]);
                 }
-                fclose(file);
-                cur_file++;
-                draw_progress(cur_file, file_cnt, 80);
         }
-        closedir(dir);
         printf("\n");
         fflush(stdout);
         return 0;
 }
 
+/*********************************************************************
+ *                      Hardware counter metrics
+*********************************************************************/
+
+enum Metric {
+        CYCLES_PER_VALUE,
+        IPC,
+        BRANCH_MISSES_PER_VALUE,
+        L1D_MISSES_PER_VALUE,
+        LLC_MISSES_PER_VALUE,
+        METRIC_COUNT,
+};
+
+const char* metric_names[METRIC_COUNT] = {
+        "cycles_per_value", "ipc", "branch_misses_per_value", "l1d_misses_per_value", "llc_misses_per_value"
+};
+
+/**
+ * Derives the per-value metrics of one stage, NAN where a counter is missing.
+ */
+void derive_metrics(PerfCounts* counts, double values, double* metrics) {
+        int per_value[METRIC_COUNT] = {PERF_EV_CYCLES, -1, PERF_EV_BRANCH_MISSES, PERF_EV_L1D_MISSES, PERF_EV_LLC_MISSES};
+        for (int m = 0; m < METRIC_COUNT; m++) {
+                int id = per_value[m];
+                metrics[m] = id >= 0 && perf_event_valid(counts, id) ? counts->count[id] / values : NAN;
+        }
+        metrics[IPC] = perf_event_valid(counts, PERF_EV_CYCLES) && perf_event_valid(counts, PERF_EV_INSTRUCTIONS)
+                ? (double) counts->count[PERF_EV_INSTRUCTIONS] / counts->count[PERF_EV_CYCLES] : NAN;
+}
+
+void report_metrics(const char* stage, PerfCounts* counts, double values) {
+        double metrics[METRIC_COUNT];
+        derive_metrics(counts, values, metrics);
+        printf("%s:", stage);
+        for (int m = 0; m < METRIC_COUNT; m++) {
+                if (isnan(metrics[m])) {
+                        printf(" %s n/a", metric_names[m]);
+                } else {
+                        printf(" %s %.3lf", metric_names[m], metrics[m]);
+                }
+        }
+        printf("\n");
+}
+
+static inline double value_count(int c) {
+        return (double) compressors[c].perf.ori_size / (compressors[c].compress_f ? sizeof(float) : sizeof(double));
+}
+
 void report(int c) {
         printf("========= %s ==========\n", compressors[c].name);
         printf("Compression ratio: %lf\n",      
@@ -316,14 +781,94 @@ void report(int c) {
         printf("Decompression speed: %lf MB/s\n", 
                 (double)compressors[c].perf.ori_size/1024/1024 / 
                 ((double)compressors[c].perf.dec_time/CLOCKS_PER_SEC));
+        if (collect_counters) {
+                report_metrics("Compression counters", &compressors[c].perf.cmp_events, value_count(c));
+                report_metrics("Decompression counters", &compressors[c].perf.dec_events, value_count(c));
+        }
         printf("\n");
         fflush(stdout);
 }
 
+/**
+ * Appends one row per (compressor, dataset, slice length) to the CSV and JSON exports.
+ * Missing counters are left empty in the CSV and null in the JSON.
+ */
+void export_report(int c, int ds, int chunk_size, FILE* csv, FILE* json) {
+        Perf* perf = &compressors[c].perf;
+        double stats[3] = {
+                (double) perf->ori_size / perf->cmp_size,
+                (double) perf->ori_size/1024/1024 / ((double) perf->cmp_time/CLOCKS_PER_SEC),
+                (double) perf->ori_size/1024/1024 / ((double) perf->dec_time/CLOCKS_PER_SEC),
+        };
+        const char* stat_names[3] = {"ratio", "cmp_mbps", "dec_mbps"};
+        double metrics[2][METRIC_COUNT];
+        derive_metrics(&perf->cmp_events, value_count(c), metrics[0]);
+        derive_metrics(&perf->dec_events, value_count(c), metrics[1]);
+        const char* stages[2] = {"cmp", "dec"};
+
+        if (csv) {
+                fprintf(csv, "%s,%s,%g,%d", compressors[c].name, datasets[ds].name, datasets[ds].error, chunk_size);
+                for (int i = 0; i < 3; i++) {
+                        fprintf(csv, ",%lf", stats[i]);
+                }
+                for (int s = 0; s < 2; s++) {
+                        for (int m = 0; m < METRIC_COUNT; m++) {
+                                if (isnan(metrics[s][m])) {
+                                        fprintf(csv, ",");
+                                } else {
+                                        fprintf(csv, ",%lf", metrics[s][m]);
+                                }
+                        }
+                }
+                fprintf(csv, "\n");
+                fflush(csv);
+        }
+        if (json) {
+                // rows are separated by a comma up front, the array is closed in main
+                fprintf(json, "%s\n  {\"compressor\": \"%s\", \"dataset\": \"%s\", \"error\": %g, \"slice\": %d",
+                        ftell(json) > 1 ? "," : "", compressors[c].name, datasets[ds].name, datasets[ds].error, chunk_size);
+                for (int i = 0; i < 3; i++) {
+                        fprintf(json, ", \"%s\": %lf", stat_names[i], stats[i]);
+                }
+                for (int s = 0; s < 2; s++) {
+                        for (int m = 0; m < METRIC_COUNT; m++) {
+                                if (isnan(metrics[s][m])) {
+                                        fprintf(json, ", \"%s_%s\": null", stages[s], metric_names[m]);
+                                } else {
+                                        fprintf(json, ", \"%s_%s\": %lf", stages[s], metric_names[m], metrics[s][m]);
+                                }
+                        }
+                }
+                fprintf(json, "}");
+                fflush(json);
+        }
+}
+
 
 int main() {
         lfzip_init();
 
+        // codec scratch memory is drawn from one arena and handed back after every block
+        Arena arena;
+        arena_init(&arena);
+        arena_bind(&arena);
+
+        system("mkdir -p cmp_product");
+        FILE* csv = csv_path ? fopen(csv_path, "w") : NULL;
+        FILE* json = json_path ? fopen(json_path, "w") : NULL;
+        if (csv) {
+                fprintf(csv, "compressor,dataset,error,slice,ratio,cmp_mbps,dec_mbps");
+                for (int s = 0; s < 2; s++) {
+                        for (int m = 0; m < METRIC_COUNT; m++) {
+                                fprintf(csv, ",%s_%s", s ? "dec" : "cmp", metric_names[m]);
+                        }
+                }
+                fprintf(csv, "\n");
+        }
+        if (json) {
+                fprintf(json, "[");
+        }
+
 // #define DEBUG_LAST_FAILED
 #ifdef DEBUG_LAST_FAILED
         // according to the dump file, debug
@@ -331,7 +876,12 @@ int main() {
         if (fp == NULL) {
                 printf("Failed to open dump.data\n");
         }
-        test_file(fp, 0, 1000, 1E-3);
+        PerfEvents events = {{-1, -1, -1, -1, -1}};
+        if (collect_counters) {
+                perf_events_open(&events);
+        }
+        test_file(fp, 0, 1000, 1E-3, &compressors[0].perf, &events, 0);
+        perf_events_close(&events);
         printf("Test finished\n");
 #else 
         for (int i = 0; bsize_list[i] != EOL; i++) {
@@ -340,15 +890,31 @@ int main() {
                 for (int j = 0; dataset_list[j] != EOL; j++) {
                         test_dataset(dataset_list[j], bsize_list[i]);
                         for (int k = 0; compressor_list[k] != EOL; k++) {
-                                if (compressor_list[k] != SKIP) {
-                                        report(compressor_list[k]);
+                                if (compressor_list[k] == SKIP) {
+                                        continue;
                                 }
+                                report(compressor_list[k]);
+                                export_report(compressor_list[k], dataset_list[j], bsize_list[i], csv, json);
                                 // reset (clear) the performance structure (Perf) after each a test/report cycle.
                                 __builtin_memset(&compressors[compressor_list[k]].perf, 0, sizeof(Perf));
                         }
                 }
         }
+        for (int j = 0; dataset_list[j] != EOL; j++) {
+                for (int k = 0; bulk_list[k] != EOL; k++) {
+                        test_bulk(dataset_list[j], bulk_list[k], bsize_list[0]);
+                }
+        }
         printf("Test finished\n");
 #endif
+        if (csv) {
+                fclose(csv);
+        }
+        if (json) {
+                fprintf(json, "\n]\n");
+                fclose(json);
+        }
+        arena_bind(NULL);
+        arena_destroy(&arena);
         return 0;
 }
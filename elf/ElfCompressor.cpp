@@ -11,48 +11,76 @@ class AbstractElfCompressor {
 private:
         size_t size = 32;
         int lastBetaStar = __INT32_MAX__;
+        int fixedFAlpha;
+        double fixedScale;
 protected:
         virtual int writeInt(int n, int len) = 0;
-        virtual int writeBit(bool bit) = 0;
-        virtual int xorCompress(long vPrimeLong) = 0;
+        // `flag` is written in front of the value, in the same write_fields as its header
+        virtual int xorCompress(long vPrimeLong, BitField flag) = 0;
 
 public:
         void addValue(double v) {
                 // when you assign v to data.d, the corresponding bit pattern is stored in the union as data.i
                 // the concrete definition of the union is in defs.h
                 DOUBLE data = {.d = v};
-                long vPrimeLong;
                 assert(!isnan(v));
-                if (v == 0.0) {
-                        size += writeInt(2,2);
-                        vPrimeLong = data.i;
-                // } else if (isnan(v)) {
-                //         size += writeInt(2,2);
-                //         vPrimeLong = 0xfff8000000000000L & data.i;
-                } else {
+                // '10': stored as is, which is how zeros (and values erasure can't shorten) go
+                BitField flag = {2, 2};
+                long vPrimeLong = data.i;
+                if (v != 0.0) {
                         int* alphaAndBetaStar = getAlphaAndBetaStar(v, lastBetaStar);
                         int e = ((int) (data.i >> 52)) & 0x7ff;
                         int gAlpha = getFAlpha(alphaAndBetaStar[0]) + e - 1023;
                         int eraseBits = 52 - gAlpha;
-                        long mask = 0xffffffffffffffffL << eraseBits;
+                        // with eraseBits <= 4 the value is stored as is, and a negative count can't shift
+                        long mask = eraseBits > 4 ? 0xffffffffffffffffL << eraseBits : -1;
                         long delta = (~mask) & data.i;
-                        if (delta != 0 && eraseBits > 4) {
+                        if (delta != 0) {
                                 if (alphaAndBetaStar[1] == lastBetaStar) {
-                                        size += writeBit(false);
+                                        flag = {0, 1};
                                 } else {
-                                        size += writeInt(alphaAndBetaStar[1] | 0x30, 6);
+                                        flag = {(uint64_t) alphaAndBetaStar[1] | 0x30, 6};
                                         lastBetaStar = alphaAndBetaStar[1];
                                 }
                                 vPrimeLong = mask & data.i;
-                        } else {
-                                size += writeInt(2,2);
-                                vPrimeLong = data.i;
                         }
-
                         delete [] alphaAndBetaStar;
-                        size += xorCompress(vPrimeLong);
                 }
-                // size += xorCompress(vPrimeLong);
+                size += flag.len + xorCompress(vPrimeLong, flag);
+        }
+
+        /**
+         * Writes the block header, '0' for a precision per value (addValue),
+         * '1' + 5 bits for `digits` decimal places shared by the block (addValueFixed).
+         */
+        void setDigits(int digits) {
+                if (digits < 0) {
+                        size += writeInt(0, 1);
+                } else {
+                        size += writeInt(0x20 | digits, 6);
+                        fixedFAlpha = getFAlpha(digits);
+                        fixedScale = get10iP(digits);
+                }
+        }
+
+        /**
+         * Every value keeps the same f(alpha) fraction bits, so there is no beta* to search for or signal:
+         * '0' erased, '1' stored as is. A value that wouldn't round back to itself is stored as is.
+         */
+        void addValueFixed(double v) {
+                DOUBLE data = {.d = v};
+                int e = ((int) (data.i >> 52)) & 0x7ff;
+                int eraseBits = 52 - (fixedFAlpha + e - 1023);
+                BitField flag = {1, 1};
+                long vPrimeLong = data.i;
+                if (v != 0.0 && eraseBits > 4 && eraseBits <= 52) {
+                        DOUBLE vPrime = {.i = data.i & (0xffffffffffffffffUL << eraseBits)};
+                        if (vPrime.i != data.i && roundUpScale(vPrime.d, fixedScale) == v) {
+                                flag = {0, 1};
+                                vPrimeLong = vPrime.i;
+                        }
+                }
+                size += flag.len + xorCompress(vPrimeLong, flag);
         }
 
         int getSize() {
@@ -93,31 +121,34 @@ private:
         BitWriter writer;
         uint32_t *output;
 
-        int writeFirst(long value) {
+        int writeFirst(long value, BitField flag) {
+                if (flag.len) {
+                        write(&writer, flag.code, flag.len);
+                }
                 first = false;
                 storedVal = value;
                 length = 1;
-                // ctzl: count triailing zeros (in) long
-                // __builtin_ctzl is a GCC/Clang built-in (intrinsic) function:
-                // pat attention: if the input is zero, the result is undefined.
-                assert(value != 0);
-                // However, in this case, Case Zero will be handled by Abstract Class already.
-                int trailingZeros = __builtin_ctzl(value); 
+                // ctzl: count triailing zeros (in) long, undefined for 0, so a zero is written as 64 trailing zeros
+                int trailingZeros = value == 0 ? 64 : __builtin_ctzl(value);
 
                 // write the trailing count
-                write(&writer, trailingZeros, 6); // (Case Zero will be handled by Abstract Class already.)
+                write(&writer, trailingZeros, 7);
+                if (trailingZeros == 64) {
+                        size += 7;
+                        return 7;
+                }
                 // write the bits excluding the trailing zeros
                 // here (trailingZeros + 1) is intentional to exclude the definite 1 bit at the end to save one bit space. (greedy)
-                writeLong(&writer, storedVal >> (trailingZeros + 1), 63 - trailingZeros);
-                size += 69 - trailingZeros;
-                return 69 - trailingZeros;
+                writeLong(&writer, storedVal >> trailingZeros >> 1, 63 - trailingZeros);
+                size += 70 - trailingZeros;
+                return 70 - trailingZeros;
         }
 
-        int compressValue(long value) {
+        int compressValue(long value, BitField flag) {
                 int thisSize = 0;
                 uint64_t _xor = storedVal ^ value;
                 if (_xor == 0) {
-                        write(&writer, 1, 2);
+                        write_fields<2>(&writer, {flag, {1, 2}});
                         size += 2;
                         thisSize += 2;
                 } else {
@@ -128,12 +159,12 @@ private:
                         if (leadingZeros == storedLeadingZeros && trailingZeros >= storedTrailingZeros) {
                                 int centerBits = 64 - storedLeadingZeros - storedTrailingZeros;
                                 int len = 2 + centerBits;
-                                // The maximum length of writeLong is 64, so do the if-logic?
-                                if (len > 64) {
-                                        write(&writer, 0, 2);
+                                // flag, header and center in one write_fields when they fit in 64 bits
+                                if (flag.len + len > 64) {
+                                        write_fields<2>(&writer, {flag, {0, 2}});
                                         writeLong(&writer, _xor >> storedTrailingZeros, centerBits);
                                 } else {
-                                        writeLong(&writer, _xor >> storedTrailingZeros, len);
+                                        write_fields<3>(&writer, {flag, {0, 2}, {_xor >> storedTrailingZeros, (uint64_t) centerBits}});
                                 }
 
                                 size += len;
@@ -144,14 +175,19 @@ private:
                                 int centerBits = 64 - storedLeadingZeros - storedTrailingZeros;
 
                                 if (centerBits <= 16) {
-                                        write(&writer, (((0x2 << 3) | leadingRepresentation[storedLeadingZeros]) << 4) | (centerBits & 0xf), 9);
-                                        writeLong(&writer, _xor >> (storedTrailingZeros + 1), centerBits - 1);
+                                        uint64_t header = (((0x2 << 3) | leadingRepresentation[storedLeadingZeros]) << 4) | (centerBits & 0xf);
+                                        write_fields<3>(&writer, {flag, {header, 9}, {_xor >> (storedTrailingZeros + 1), (uint64_t) centerBits - 1}});
 
                                         size += 8 + centerBits;
                                         thisSize += 8 + centerBits;
                                 } else {
-                                        write(&writer, (((0x3 << 3) | leadingRepresentation[storedLeadingZeros]) << 6) | (centerBits & 0x3f), 11);
-                                        writeLong(&writer, _xor >> (storedTrailingZeros + 1), centerBits - 1);
+                                        uint64_t header = (((0x3 << 3) | leadingRepresentation[storedLeadingZeros]) << 6) | (centerBits & 0x3f);
+                                        if (flag.len + 11 + centerBits - 1 <= 64) {
+                                                write_fields<3>(&writer, {flag, {header, 11}, {_xor >> (storedTrailingZeros + 1), (uint64_t) centerBits - 1}});
+                                        } else {
+                                                write_fields<2>(&writer, {flag, {header, 11}});
+                                                writeLong(&writer, _xor >> (storedTrailingZeros + 1), centerBits - 1);
+                                        }
 
                                         size += 10 + centerBits;
                                         thisSize += 10 + centerBits;
@@ -179,20 +215,20 @@ public:
                 initBitWriter(&writer, output+1, length/sizeof(uint32_t));
         }
 
-        int addValue(long value) {
+        int addValue(long value, BitField flag = {0, 0}) {
                 if (first) {
-                        return writeFirst(value);
+                        return writeFirst(value, flag);
                 } else {
-                        return compressValue(value);
+                        return compressValue(value, flag);
                 }
         }
 
-        int addValue(double value) {
+        int addValue(double value, BitField flag = {0, 0}) {
                 DOUBLE data = {.d = value};
                 if (first) {
-                        return writeFirst(data.i);
+                        return writeFirst(data.i, flag);
                 } else {
-                        return compressValue(data.i);
+                        return compressValue(data.i, flag);
                 }
         }
 
@@ -221,13 +257,8 @@ protected:
                 return len;
         }
 
-        int writeBit(bool bit) override {
-                write(xorCompressor.getWriter(), bit, 1);
-                return 1;
-        }
-
-        int xorCompress(long vPrimeLong) override {
-                return xorCompressor.addValue(vPrimeLong);
+        int xorCompress(long vPrimeLong, BitField flag) override {
+                return xorCompressor.addValue(vPrimeLong, flag);
         }
 
 public: 
@@ -244,20 +275,32 @@ public:
         }
 };
 
-ssize_t elf_encode(double* in, ssize_t len, uint8_t** out, double error) {
+ssize_t elf_encode_digits(double* in, ssize_t len, uint8_t** out, int digits) {
         ElfCompressor compressor;
         compressor.init(len);
+        if (digits == ELF_DIGITS_DETECT) {
+                digits = getBlockDigits(in, len);
+        }
+        if (digits > ELF_MAX_DIGITS) {
+                digits = ELF_DIGITS_NONE;
+        }
+        compressor.setDigits(digits);
 
         // Here implmentation of the end of ELF is NOT NaN.
-        for (int i = 0; i < len; i++) {
-                if (i == 4219) {
-                        // asm is a GCC/Clang extension to allow inline assembly
-                        // it used as a marker or breakpoint at i == 4219
-                        asm("nop");
+        if (digits >= 0) {
+                for (int i = 0; i < len; i++) {
+                        compressor.addValueFixed(in[i]);
+                }
+        } else {
+                for (int i = 0; i < len; i++) {
+                        compressor.addValue(in[i]);
                 }
-                compressor.addValue(in[i]);
         }
         compressor.close();
         *out = (uint8_t*) compressor.getBytes();
         return (compressor.getSize() + 31) / 32 * 4;
-}
\ No newline at end of file
+}
+
+ssize_t elf_encode(double* in, ssize_t len, uint8_t** out, double error) {
+        return elf_encode_digits(in, len, out, ELF_DIGITS_DETECT);
+}
@@ -6,40 +6,103 @@
 #include "defs.h"
 #include "BitStream/BitWriter.h"
 #include "BitStream/BitReader.h"
+#include "Arena/Arena.h"
+
+// Decoding takes two passes over a block:
+//  1. the bit stream alone, every XOR'd value (vPrime) goes to the output and its beta* to a side array,
+//  2. the decimal restoration, ELF_RESTORE_BLOCK values at a time, in loops free of the bit parsing.
+// The serial bit parsing then never waits on the division of roundUp, and the
+// restoration loops carry no dependency from one value to the next.
+
+#define ELF_STORED              -1      // beta* of a value stored as is
+#define ELF_RESTORE_BLOCK       256
+
+// getSP compares against these same constants, so the fast path finds the same sp
+#define ELF_SP_MIN              -10
+#define ELF_SP_MAX              9
+static const double pow10Table[] =
+{1.0E-10, 1.0E-9, 1.0E-8, 1.0E-7, 1.0E-6, 1.0E-5, 1.0E-4, 1.0E-3, 1.0E-2, 1.0E-1,
+1.0, 1.0E1, 1.0E2, 1.0E3, 1.0E4, 1.0E5, 1.0E6, 1.0E7, 1.0E8, 1.0E9};
+
+static const double map10iP[] =
+{1.0, 1.0E1, 1.0E2, 1.0E3, 1.0E4, 1.0E5, 1.0E6, 1.0E7,
+1.0E8, 1.0E9, 1.0E10, 1.0E11, 1.0E12, 1.0E13, 1.0E14,
+1.0E15, 1.0E16, 1.0E17, 1.0E18, 1.0E19, 1.0E20};
+
+/**
+ * getSP for v in [1e-10, 1e9): floor(log2 v) * log10(2) is floor(log10 v) or one less,
+ * a single table comparison settles which.
+ */
+static inline int fastSP(double v) {
+        DOUBLE d = {.d = v};
+        int e = (int) ((d.i >> 52) & 0x7ff) - 1023;
+        int sp = (e * 1233) >> 12;      // 1233 / 4096 ~ log10(2), floor for negative e too
+        return sp + (v >= pow10Table[sp + 1 - ELF_SP_MIN]);
+}
+
+static inline double fast10iP(int i) {
+        return i < (int) (sizeof(map10iP) / sizeof(map10iP[0])) ? map10iP[i] : get10iP(i);
+}
+
+/**
+ * Turns the vPrime in `values` back into the original decimals, same as
+ * recoverVByBetaStar, with `betaStar` ELF_STORED for values stored as is.
+ */
+static void restoreDecimals(double* values, const int8_t* betaStar, ssize_t len) {
+        int sp[ELF_RESTORE_BLOCK];
+        double scale[ELF_RESTORE_BLOCK];
+        for (ssize_t base = 0; base < len; base += ELF_RESTORE_BLOCK) {
+                double* v = values + base;
+                const int8_t* b = betaStar + base;
+                int n = len - base < ELF_RESTORE_BLOCK ? len - base : ELF_RESTORE_BLOCK;
+
+                for (int j = 0; j < n; j++) {
+                        double a = fabs(v[j]);
+                        sp[j] = a >= pow10Table[0] && a < pow10Table[ELF_SP_MAX - ELF_SP_MIN] ? fastSP(a) : getSP(a);
+                }
+                for (int j = 0; j < n; j++) {
+                        if (b[j] > 0) {
+                                scale[j] = fast10iP(b[j] - sp[j] - 1);
+                        } else {
+                                scale[j] = 1;
+                                if (b[j] == 0) {
+                                        // beta* 0 is a power of ten below 1
+                                        v[j] = v[j] < 0 ? -get10iN(-sp[j] - 1) : get10iN(-sp[j] - 1);
+                                }
+                        }
+                }
+                // roundUp: a division stays exact where a reciprocal would not, but here the divides overlap
+                for (int j = 0; j < n; j++) {
+                        double r = roundUpScale(v[j], scale[j]);
+                        v[j] = b[j] > 0 ? r : v[j];
+                }
+        }
+}
+
+/**
+ * restoreDecimals for a block with `digits` decimal places throughout, which needs no sp.
+ */
+static void restoreFixedDecimals(double* values, const int8_t* betaStar, ssize_t len, int digits) {
+        double scale = get10iP(digits);
+        for (ssize_t i = 0; i < len; i++) {
+                double r = roundUpScale(values[i], scale);
+                values[i] = betaStar[i] == ELF_STORED ? values[i] : r;
+        }
+}
 
 class AbstractElfDecompressor {
 private:
         int lastBetaStar = __INT32_MAX__;
 
-        double nextValue() {
-                double v;
+        int nextBetaStar() {
                 if (readInt(1) == 0) {
-                        v = recoverVByBetaStar();
+                        return lastBetaStar;
                 } else if (readInt(1) == 0) {
-                        // v = xorDecompress();
-                        // when you assume the data to be compressed have been clean already.
-                        v = 0.0;
+                        return ELF_STORED;
                 } else {
                         lastBetaStar = readInt(4);
-                        v = recoverVByBetaStar();
-                }
-                return v;
-        }
-
-        double recoverVByBetaStar() {
-                double v;
-                double vPrime = xorDecompress();
-                int sp = getSP(abs(vPrime));
-                if (lastBetaStar == 0) {
-                        v = get10iN(-sp - 1);
-                        if (vPrime < 0) {
-                                v = -v;
-                        }
-                } else {
-                        int alpha = lastBetaStar - sp - 1;
-                        v = roundUp(vPrime, alpha);
+                        return lastBetaStar;
                 }
-                return v;
         }
 protected:
         virtual double xorDecompress() = 0;
@@ -48,12 +111,23 @@ protected:
 public: 
         int decompress(double* output) {
                 int len = getLength();
-                for (int i = 0; i < len; i++) {
-                        if (i == 4219) {
-                                asm("nop");
+                int8_t* betaStar = (int8_t*) scratch_alloc(len);
+                if (readInt(1)) {
+                        // fixed decimal places, a 1-bit flag per value
+                        int digits = readInt(5);
+                        for (int i = 0; i < len; i++) {
+                                betaStar[i] = readInt(1) ? ELF_STORED : digits;
+                                output[i] = xorDecompress();
                         }
-                        output[i] = nextValue();
+                        restoreFixedDecimals(output, betaStar, len, digits);
+                } else {
+                        for (int i = 0; i < len; i++) {
+                                betaStar[i] = nextBetaStar();
+                                output[i] = xorDecompress();
+                        }
+                        restoreDecimals(output, betaStar, len);
                 }
+                scratch_free(betaStar);
                 return len;
         }
 };
@@ -73,8 +147,8 @@ private:
         void next() {
                 if (first) {
                         first = false;
-                        int trailingZeros = peek(&reader, 6);
-                        forward(&reader, 6);
+                        int trailingZeros = peek(&reader, 7);
+                        forward(&reader, 7);
                         if (trailingZeros < 64) {
                                 storedVal.i = ((readLong(&reader, 63 - trailingZeros) << 1) + 1) << trailingZeros;
                         } else {
@@ -179,6 +253,7 @@ public:
 };
 
 ssize_t elf_decode(uint8_t* in, ssize_t len, double* out, double error) {
+        ArenaScope scope;
         ElfDecompressor decompressor(in, len);
         return decompressor.decompress(out); 
 }
\ No newline at end of file
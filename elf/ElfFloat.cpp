@@ -0,0 +1,252 @@
+#include <cstdint>
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "elf.h"
+#include "defs.h"
+#include "BitStream/BitWriter.h"
+#include "BitStream/BitReader.h"
+
+// Single-precision Elf.
+// Every value starts with a flag:
+//      '0'             erased, same beta* as the last erased value
+//      '11' + 4 bits   erased, new beta*
+//      '10'            stored as is
+// followed by the value (after erasure) in a 32-bit XOR encoding:
+//      '01'                            same as the previous value
+//      '00' + center                   same leading zeros, at least as many trailing zeros
+//      '10' + 3 + 3 bits + center-1    new leading zeros and a center of at most 8 bits
+//      '11' + 3 + 5 bits + center-1    new leading zeros and a longer center
+// The lowest center bit is always 1 after a new window and is not stored.
+
+union FLOAT {
+        float f;
+        uint32_t i;
+};
+
+static const short leadingRepresentation[] =
+{0, 0, 0, 0, 0, 0, 0, 0,
+1, 1, 1, 1, 2, 2, 2, 2,
+3, 3, 4, 4, 5, 5, 6, 6,
+7, 7, 7, 7, 7, 7, 7, 7
+};
+
+static const short leadingRound[] =
+{0, 0, 0, 0, 0, 0, 0, 0,
+8, 8, 8, 8, 12, 12, 12, 12,
+16, 16, 18, 18, 20, 20, 22, 22,
+24, 24, 24, 24, 24, 24, 24, 24
+};
+
+static const short leadingDecode[] =
+{0, 8, 12, 16, 18, 20, 22, 24};
+
+// the most significant decimal digits a float needs to round trip is 9
+#define FLOAT_MAX_BETA 8
+
+/**
+ * Fewest significant decimal digits of `v` (v > 0) that still round to the same float,
+ * or 0 if more than FLOAT_MAX_BETA are needed.
+ */
+static int getFloatBeta(double v, int sp) {
+        for (int beta = 1; beta <= FLOAT_MAX_BETA; beta++) {
+                int i = beta - sp - 1;
+                if (i < 0) {
+                        continue;
+                }
+                double scale = get10iP(i);
+                if ((float) (round(v * scale) / scale) == (float) v) {
+                        return beta;
+                }
+        }
+        return 0;
+}
+
+static inline float recoverByBetaStar(float vPrime, int betaStar) {
+        int sp = getSP(fabs(vPrime));
+        int alpha = betaStar - sp - 1;
+        return (float) roundUp(vPrime, alpha > 0 ? alpha : 0);
+}
+
+class ElfFloatCompressor {
+private:
+        BitWriter writer;
+        uint32_t* output;
+        int lastBetaStar = __INT32_MAX__;
+        int storedLeadingZeros = __INT32_MAX__;
+        int storedTrailingZeros = __INT32_MAX__;
+        uint32_t storedVal = 0;
+        bool first = true;
+
+        // the flag (at most 6 bits) and the value take a single write_fields, at most 6 + 10 + 31 bits
+        void xorCompress(uint32_t value, BitField flag) {
+                if (first) {
+                        first = false;
+                        storedVal = value;
+                        write_fields<2>(&writer, {flag, {value, 32}});
+                        return;
+                }
+                uint32_t _xor = storedVal ^ value;
+                if (_xor == 0) {
+                        write_fields<2>(&writer, {flag, {1, 2}});
+                        return;
+                }
+                int leadingZeros = leadingRound[__builtin_clz(_xor)];
+                int trailingZeros = __builtin_ctz(_xor);
+                if (leadingZeros == storedLeadingZeros && trailingZeros >= storedTrailingZeros) {
+                        uint64_t centerBits = 32 - storedLeadingZeros - storedTrailingZeros;
+                        write_fields<3>(&writer, {flag, {0, 2}, {_xor >> storedTrailingZeros, centerBits}});
+                } else {
+                        storedLeadingZeros = leadingZeros;
+                        storedTrailingZeros = trailingZeros;
+                        uint64_t centerBits = 32 - leadingZeros - trailingZeros;
+                        BitField header;
+                        if (centerBits <= 8) {
+                                header = {(((0x2 << 3) | (uint64_t) leadingRepresentation[leadingZeros]) << 3) | (centerBits & 0x7), 8};
+                        } else {
+                                header = {(((0x3 << 3) | (uint64_t) leadingRepresentation[leadingZeros]) << 5) | (centerBits & 0x1f), 10};
+                        }
+                        write_fields<3>(&writer, {flag, header, {(_xor >> trailingZeros) >> 1, centerBits - 1}});
+                }
+                storedVal = value;
+        }
+
+public:
+        void init(size_t length) {
+                size_t words = SIZE_IN_BIT(48 * length + 32);
+                output = (uint32_t*) malloc(4 + words * 4);
+                *output = length;
+                initBitWriter(&writer, output + 1, words);
+        }
+
+        void addValue(float v) {
+                FLOAT data = {.f = v};
+                uint32_t vPrime = data.i;
+                int e = (data.i >> 23) & 0xff;
+                // zeros, subnormals, infinities and NaNs are stored as is
+                if (e != 0 && e != 0xff) {
+                        int sp = getSP(fabs(v));
+                        int betaStar = getFloatBeta(fabs(v), sp);
+                        if (betaStar) {
+                                int gAlpha = getFAlpha(betaStar - sp - 1) + e - 127;
+                                int eraseBits = 23 - gAlpha;
+                                eraseBits = eraseBits > 23 ? 23 : eraseBits;
+                                // only erase when the decoder is known to round back to v
+                                if (eraseBits > 3) {
+                                        FLOAT erased = {.i = data.i & (0xffffffffu << eraseBits)};
+                                        FLOAT check = {.f = recoverByBetaStar(erased.f, betaStar)};
+                                        if (erased.i != data.i && check.i == data.i) {
+                                                vPrime = erased.i;
+                                        }
+                                }
+                        }
+                        if (vPrime != data.i) {
+                                if (betaStar == lastBetaStar) {
+                                        xorCompress(vPrime, {0, 1});
+                                } else {
+                                        lastBetaStar = betaStar;
+                                        xorCompress(vPrime, {(uint64_t) betaStar | 0x30, 6});
+                                }
+                                return;
+                        }
+                }
+                xorCompress(vPrime, {2, 2});
+        }
+
+        ssize_t close(uint8_t** out) {
+                *out = (uint8_t*) output;
+                return 4 + flush(&writer) * 4;
+        }
+};
+
+class ElfFloatDecompressor {
+private:
+        BitReader reader;
+        int lastBetaStar = __INT32_MAX__;
+        int storedLeadingZeros = __INT32_MAX__;
+        int storedTrailingZeros = __INT32_MAX__;
+        FLOAT storedVal = {.i = 0};
+        bool first = true;
+
+        uint32_t readInt(int len) {
+                uint32_t res = peek(&reader, len);
+                forward(&reader, len);
+                return res;
+        }
+
+        float xorDecompress() {
+                if (first) {
+                        first = false;
+                        storedVal.i = readInt(32);
+                        return storedVal.f;
+                }
+                int centerBits;
+                uint32_t leadAndCenter;
+                switch (readInt(2)) {
+                case 3:
+                        leadAndCenter = readInt(8);
+                        storedLeadingZeros = leadingDecode[leadAndCenter >> 5];
+                        centerBits = leadAndCenter & 0x1f;
+                        if (centerBits == 0) {
+                                centerBits = 32;
+                        }
+                        storedTrailingZeros = 32 - storedLeadingZeros - centerBits;
+                        storedVal.i ^= ((readLong(&reader, centerBits - 1) << 1) + 1) << storedTrailingZeros;
+                        break;
+                case 2:
+                        leadAndCenter = readInt(6);
+                        storedLeadingZeros = leadingDecode[leadAndCenter >> 3];
+                        centerBits = leadAndCenter & 0x7;
+                        if (centerBits == 0) {
+                                centerBits = 8;
+                        }
+                        storedTrailingZeros = 32 - storedLeadingZeros - centerBits;
+                        storedVal.i ^= ((readLong(&reader, centerBits - 1) << 1) + 1) << storedTrailingZeros;
+                        break;
+                case 1:
+                        break;
+                default:
+                        centerBits = 32 - storedLeadingZeros - storedTrailingZeros;
+                        storedVal.i ^= readInt(centerBits) << storedTrailingZeros;
+                        break;
+                }
+                return storedVal.f;
+        }
+
+public:
+        uint32_t length;
+
+        ElfFloatDecompressor(uint8_t* in, size_t len) {
+                length = *(uint32_t*) in;
+                initBitReader(&reader, (uint32_t*) in + 1, len / 4 - 1);
+        }
+
+        float nextValue() {
+                if (readInt(1) == 0) {
+                        return recoverByBetaStar(xorDecompress(), lastBetaStar);
+                } else if (readInt(1) == 0) {
+                        return xorDecompress();
+                } else {
+                        lastBetaStar = readInt(4);
+                        return recoverByBetaStar(xorDecompress(), lastBetaStar);
+                }
+        }
+};
+
+ssize_t elf_encode_float(float* in, ssize_t len, uint8_t** out, double error) {
+        ElfFloatCompressor compressor;
+        compressor.init(len);
+        for (int i = 0; i < len; i++) {
+                compressor.addValue(in[i]);
+        }
+        return compressor.close(out);
+}
+
+ssize_t elf_decode_float(uint8_t* in, ssize_t len, float* out, double error) {
+        ElfFloatDecompressor decompressor(in, len);
+        for (int i = 0; i < decompressor.length; i++) {
+                out[i] = decompressor.nextValue();
+        }
+        return decompressor.length;
+}
@@ -1,6 +1,8 @@
 #pragma once 
 
 #include <stdint.h>
+#include <stddef.h>
+#include <math.h>
 
 union DOUBLE {
         double d;
@@ -11,5 +13,18 @@ union DOUBLE {
 int getFAlpha(int alpha);
 int* getAlphaAndBetaStar(double v, int lastBetaStar);
 double roundUp(double v, int alpha);
+double get10iP(int i);
 double get10iN(int i);
-int getSP(double v);
\ No newline at end of file
+int getSP(double v);
+
+// Decimal places shared by a block (0 to ELF_MAX_DIGITS), or -1 if there are none.
+#define ELF_MAX_DIGITS  15
+int getBlockDigits(double* in, ssize_t len);
+
+/**
+ * roundUp with the scale 10^alpha already looked up, so callers
+ * restoring many values with the same alpha share one table lookup.
+ */
+static inline double roundUpScale(double v, double scale) {
+        return (v < 0 ? floor(v * scale) : ceil(v * scale)) / scale;
+}
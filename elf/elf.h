@@ -10,6 +10,18 @@ extern "C" {
 ssize_t elf_encode(double* in, ssize_t len, uint8_t** out, double error);
 ssize_t elf_decode(uint8_t* in, ssize_t len, double* out, double error);
 
+// Elf with the decimal places shared by the whole block (e.g. prices with 2), which elf_encode
+// scans for first. Such a block skips the beta* search and codes a 1-bit flag per value.
+// `digits` is the known number of places, ELF_DIGITS_DETECT to scan for it
+// or ELF_DIGITS_NONE for a precision per value as in the original Elf.
+#define ELF_DIGITS_DETECT       -1
+#define ELF_DIGITS_NONE         -2
+ssize_t elf_encode_digits(double* in, ssize_t len, uint8_t** out, int digits);
+
+// Single-precision variant, erasing float mantissa bits ahead of a 32-bit XOR stage.
+ssize_t elf_encode_float(float* in, ssize_t len, uint8_t** out, double error);
+ssize_t elf_decode_float(uint8_t* in, ssize_t len, float* out, double error);
+
 #ifdef __cplusplus
 }
 #endif 
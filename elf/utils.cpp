@@ -30,7 +30,6 @@ static const double mapSPLess1[] =
 static const double LOG_2_10 = 3.321928095;
 
 static int getSignificantCount(double v, int sp, int lastBetaStar);
-static double get10iP(int i);
 static int* getSPAnd10iNFlag(double v);
 
 int getFAlpha(int alpha) {
@@ -54,12 +53,26 @@ int* getAlphaAndBetaStar(double v, int lastBetaStar) {
 }
 
 double roundUp(double v, int alpha) {
-        double scale = get10iP(alpha);
-        if (v < 0) {
-                return floorf64(v * scale) / scale;
-        } else {
-                return ceil(v * scale) / scale;
+        return roundUpScale(v, get10iP(alpha));
+}
+
+/**
+ * The fewest decimal places every value of `in` round trips with, which is the
+ * alpha of the widest value. Stops at the first value needing more than ELF_MAX_DIGITS.
+ */
+int getBlockDigits(double* in, ssize_t len) {
+        int digits = 0;
+        double scale = 1;
+        for (ssize_t i = 0; i < len; i++) {
+                double v = in[i];
+                while (round(v * scale) / scale != v) {
+                        if (++digits > ELF_MAX_DIGITS || !isfinite(v)) {
+                                return -1;
+                        }
+                        scale = map10iP[digits];
+                }
         }
+        return digits;
 }
 
 static int getSignificantCount(double v, int sp, int lastBetaStar) {
@@ -94,7 +107,7 @@ static int getSignificantCount(double v, int sp, int lastBetaStar) {
         }
 }
 
-static double get10iP(int i) {
+double get10iP(int i) {
         assert(i >= 0);
         if (i >= LENGTH_OF(map10iP)) {
                 return powf64(10, i);
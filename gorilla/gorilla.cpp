@@ -4,7 +4,10 @@
 #include <stdio.h>
 #include "BitStream/BitWriter.h"
 #include "BitStream/BitReader.h"
+#include "Arena/Arena.h"
+#include "Truncate/Truncate.h"
 #include "gorilla.h"
+#include "gorilla_stream.h"
 
 ssize_t gorilla_encode(double* in, ssize_t len, uint8_t** out, double error) {
         assert(len > 0);
@@ -15,84 +18,95 @@ ssize_t gorilla_encode(double* in, ssize_t len, uint8_t** out, double error) {
         *(double*) (*out + 4) = in[0];
         BitWriter writer;
         initBitWriter(&writer, (uint32_t*) (*out+4+8), buffer_size / 4 - 2);
-        
-        uint64_t prevLeading = -1L;
-        uint64_t prevTrailing = 0;
-        uint64_t leading, trailing;
-        uint64_t mask;
-        double sum;
+        GorillaEncoder enc;
+        gorilla_encoder_init(&enc);
 
         uint64_t* data = (uint64_t*) in;
         for (int i = 1; i < len; i++) {
-                uint64_t vDelta = data[i] ^ data[i-1];
+                gorilla_encode_value(&writer, &enc, data[i-1], data[i]);
+        }
+
+        return flush(&writer) * 4 + 4 + 8;
+}
+
+ssize_t gorilla_decode(uint8_t* in, ssize_t len, double* out, double error) {
+        uint32_t data_len = *(uint32_t*) in;
+        out[0] = *(double*) (in + 4);
+        BitReader reader;
+        assert((len - 4 - 8) % 4 == 0);
+        initBitReader(&reader, (uint32_t*) (in + 4 + 8), (len - 4 - 8) / 4);
+        GorillaDecoder dec;
+
+        uint64_t *data = (uint64_t*) out;
+        for (int i = 1; i < data_len; i++) {
+                data[i] = gorilla_decode_value(&reader, &dec, data[i-1]);
+        }
+        return data_len;
+}
+
+ssize_t gorilla_encode_lossy(double* in, ssize_t len, uint8_t** out, double error) {
+        ArenaScope scope;
+        double* truncated = (double*) scratch_alloc(len * sizeof(double));
+        truncate_mantissa(in, len, truncated, error);
+        ssize_t size = gorilla_encode(truncated, len, out, error);
+        scratch_free(truncated);
+        return size;
+}
+
+ssize_t gorilla_encode_float(float* in, ssize_t len, uint8_t** out, double error) {
+        assert(len > 0);
+
+        size_t buffer_size = SIZE_IN_BIT((1 + 1 + 5 + 5 + 32) * len) * 4; 
+        *out = (uint8_t*) malloc(4 + 4 + buffer_size);
+        *(uint32_t*) *out = len;
+        *(float*) (*out + 4) = in[0];
+        BitWriter writer;
+        initBitWriter(&writer, (uint32_t*) (*out+4+4), buffer_size / 4);
+        
+        uint32_t prevLeading = -1;
+        uint32_t prevTrailing = 0;
+        uint32_t leading, trailing;
+
+        uint32_t* data = (uint32_t*) in;
+        for (int i = 1; i < len; i++) {
+                uint32_t vDelta = data[i] ^ data[i-1];
                 if (vDelta == 0) {
                         write(&writer, 0, 1);
                         continue;
                 }
 
-                // if (i == 930) {
-                //         printf("!\n");
-                // }
-
-                leading = __builtin_clzl(vDelta);
-                trailing = __builtin_ctzl(vDelta);
+                leading = __builtin_clz(vDelta);
+                trailing = __builtin_ctz(vDelta);
+                uint32_t l;
 
-                leading = (leading >= 32) ? 31 : leading;
-                uint64_t l;
-
-                if (prevLeading != -1L && leading >= prevLeading && trailing >= prevTrailing) {
-                        write(&writer, 2, 2);
-                        l = 64 - prevLeading - prevTrailing;
+                // at most 2 + 5 + 5 + 32 bits, always a single write_fields
+                if (prevLeading != -1 && leading >= prevLeading && trailing >= prevTrailing) {
+                        l = 32 - prevLeading - prevTrailing;
+                        write_fields<2>(&writer, {{2, 2}, {vDelta >> prevTrailing, l}});
                 } else {
                         prevLeading = leading;
                         prevTrailing = trailing;
-                        l = 64 - leading - trailing;
-
-                        write(&writer, 3, 2);
-                        write(&writer, leading, 5);
-                        write(&writer, l-1, 6);
-                }
-
-                if (l <= 32) {
-                        write(&writer, vDelta >> prevTrailing, l);
-                } else {
-                        write(&writer, vDelta >> 32, 32-prevLeading);
-                        write(&writer, vDelta >> prevTrailing, 32-prevTrailing);
+                        l = 32 - leading - trailing;
+                        write_fields<4>(&writer, {{3, 2}, {leading, 5}, {l - 1, 5}, {vDelta >> trailing, l}});
                 }
         }
 
-        return flush(&writer) * 4 + 4 + 8;
+        return flush(&writer) * 4 + 4 + 4;
 }
 
-uint64_t read_delta(BitReader* reader, uint64_t leading, uint64_t meaningful) {
-        uint64_t trailing = 64 - leading - meaningful;
-        uint64_t delta;
-        if (meaningful > 32) {
-                delta = peek(reader, 32);
-                forward(reader, 32);
-                delta <<= meaningful - 32;
-                delta |= peek(reader, meaningful - 32);
-                forward(reader, meaningful-32);
-        } else {
-                delta = peek(reader, meaningful);
-                forward(reader, meaningful);
-        }
-        return delta << trailing;
-}
-
-ssize_t gorilla_decode(uint8_t* in, ssize_t len, double* out, double error) {
+ssize_t gorilla_decode_float(uint8_t* in, ssize_t len, float* out, double error) {
         uint32_t data_len = *(uint32_t*) in;
-        out[0] = *(double*) (in + 4);
+        out[0] = *(float*) (in + 4);
+        if (len == 4 + 4) {
+                return data_len;
+        }
         BitReader reader;
-        assert((len - 4 - 8) % 4 == 0);
-        initBitReader(&reader, (uint32_t*) (in + 4 + 8), (len - 4 - 8) / 4);
+        assert((len - 4 - 4) % 4 == 0);
+        initBitReader(&reader, (uint32_t*) (in + 4 + 4), (len - 4 - 4) / 4);
 
-        uint64_t *data = (uint64_t*) out;
-        uint64_t leading, meaningful, delta;
+        uint32_t *data = (uint32_t*) out;
+        uint32_t leading, meaningful, delta;
         for (int i = 1; i < data_len; i++) {
-                // if (i == 930) {
-                //         printf("!\n");
-                // }
                 switch (peek(&reader, 2))
                 {
                 case 0:
@@ -102,21 +116,23 @@ ssize_t gorilla_decode(uint8_t* in, ssize_t len, double* out, double error) {
                         break;
                 case 2:
                         forward(&reader, 2);
-                        delta = read_delta(&reader, leading, meaningful);
-                        data[i] = data[i-1] ^ delta;
+                        delta = peek(&reader, meaningful);
+                        forward(&reader, meaningful);
+                        data[i] = data[i-1] ^ (delta << (32 - leading - meaningful));
                         break;
                 case 3:
                         forward(&reader, 2);
                         leading = peek(&reader, 5);
                         forward(&reader, 5);
-                        meaningful = peek(&reader, 6) + 1;
-                        forward(&reader, 6);
-                        delta = read_delta(&reader, leading, meaningful);
-                        data[i] = data[i-1] ^ delta;
+                        meaningful = peek(&reader, 5) + 1;
+                        forward(&reader, 5);
+                        delta = peek(&reader, meaningful);
+                        forward(&reader, meaningful);
+                        data[i] = data[i-1] ^ (delta << (32 - leading - meaningful));
                         break;
                 default:
                         break;
                 }
         }
         return data_len;
-}
\ No newline at end of file
+}
@@ -10,6 +10,22 @@ extern "C" {
 ssize_t gorilla_encode(double* in, ssize_t len, uint8_t** out, double error);
 ssize_t gorilla_decode(uint8_t* in, ssize_t len, double* out, double error);
 
+// Lossy mode: the low mantissa bits within `error` are cleared first (inc/Truncate/Truncate.h),
+// the stream is decoded by gorilla_decode.
+ssize_t gorilla_encode_lossy(double* in, ssize_t len, uint8_t** out, double error);
+
+// Single-precision variant: 32-bit XORs with a 5-bit leading-zero and a 5-bit length field.
+ssize_t gorilla_encode_float(float* in, ssize_t len, uint8_t** out, double error);
+ssize_t gorilla_decode_float(uint8_t* in, ssize_t len, float* out, double error);
+
+// Delta-of-delta timestamp column codec.
+ssize_t timestamp_encode(int64_t* in, ssize_t len, uint8_t** out);
+ssize_t timestamp_decode(uint8_t* in, ssize_t len, int64_t* out);
+
+// Paired (timestamp, value) series: both columns in one block, decoded together.
+ssize_t series_encode(int64_t* ts, double* values, ssize_t len, uint8_t** out);
+ssize_t series_decode(uint8_t* in, ssize_t len, int64_t* ts, double* values);
+
 #ifdef __cplusplus
 }
 #endif 
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include "BitStream/BitWriter.h"
+#include "BitStream/BitReader.h"
+
+// Per-value steps of the Gorilla codecs, so several columns can be coded in one loop.
+
+typedef struct {
+        uint64_t prevLeading;
+        uint64_t prevTrailing;
+} GorillaEncoder;
+
+typedef struct {
+        uint64_t leading;
+        uint64_t meaningful;
+} GorillaDecoder;
+
+static inline void
+gorilla_encoder_init(GorillaEncoder* enc) {
+        enc->prevLeading = -1L;
+        enc->prevTrailing = 0;
+}
+
+static inline void
+gorilla_encode_value(BitWriter* writer, GorillaEncoder* enc, uint64_t prev, uint64_t cur) {
+        uint64_t vDelta = cur ^ prev;
+        if (vDelta == 0) {
+                write(writer, 0, 1);
+                return;
+        }
+
+        uint64_t leading = __builtin_clzl(vDelta);
+        uint64_t trailing = __builtin_ctzl(vDelta);
+
+        leading = (leading >= 32) ? 31 : leading;
+        uint64_t l;
+
+        // header and payload go out in one write_fields whenever they fit in 64 bits
+        if (enc->prevLeading != -1L && leading >= enc->prevLeading && trailing >= enc->prevTrailing) {
+                l = 64 - enc->prevLeading - enc->prevTrailing;
+                if (l <= 64 - 2) {
+                        write_fields<2>(writer, {{2, 2}, {vDelta >> enc->prevTrailing, l}});
+                        return;
+                }
+                write(writer, 2, 2);
+        } else {
+                enc->prevLeading = leading;
+                enc->prevTrailing = trailing;
+                l = 64 - leading - trailing;
+                if (l <= 64 - 13) {
+                        write_fields<4>(writer, {{3, 2}, {leading, 5}, {l - 1, 6}, {vDelta >> trailing, l}});
+                        return;
+                }
+                write_fields<3>(writer, {{3, 2}, {leading, 5}, {l - 1, 6}});
+        }
+        writeLong(writer, vDelta >> enc->prevTrailing, l);
+}
+
+static inline uint64_t
+gorilla_read_delta(BitReader* reader, uint64_t leading, uint64_t meaningful) {
+        uint64_t trailing = 64 - leading - meaningful;
+        uint64_t delta;
+        if (meaningful > 32) {
+                delta = peek(reader, 32);
+                forward(reader, 32);
+                delta <<= meaningful - 32;
+                delta |= peek(reader, meaningful - 32);
+                forward(reader, meaningful-32);
+        } else {
+                delta = peek(reader, meaningful);
+                forward(reader, meaningful);
+        }
+        return delta << trailing;
+}
+
+static inline uint64_t
+gorilla_decode_value(BitReader* reader, GorillaDecoder* dec, uint64_t prev) {
+        switch (peek(reader, 2))
+        {
+        case 2:
+                forward(reader, 2);
+                return prev ^ gorilla_read_delta(reader, dec->leading, dec->meaningful);
+        case 3:
+                forward(reader, 2);
+                dec->leading = peek(reader, 5);
+                forward(reader, 5);
+                dec->meaningful = peek(reader, 6) + 1;
+                forward(reader, 6);
+                return prev ^ gorilla_read_delta(reader, dec->leading, dec->meaningful);
+        default:
+                forward(reader, 1);
+                return prev;
+        }
+}
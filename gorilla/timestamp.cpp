@@ -0,0 +1,218 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "BitStream/BitWriter.h"
+#include "BitStream/BitReader.h"
+#include "gorilla.h"
+#include "gorilla_stream.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Delta-of-delta timestamp coding, the zigzagged delta-of-delta goes to the first bucket it fits:
+//      '0'                     0
+//      '10'    + 7 bits
+//      '110'   + 9 bits
+//      '1110'  + 12 bits
+//      '1111'  + 64 bits
+// The first timestamp is stored as is and its delta is taken as 0.
+
+#define TS_MAX_BITS     (4 + 64)
+
+// The bit streams follow the headers. Their start is computed from the block pointer,
+// a member of a packed struct cannot be handed out as an aligned pointer.
+typedef struct __attribute__((__packed__)) {
+        uint32_t data_len;
+        int64_t first;
+} TimestampHeader;
+
+typedef struct __attribute__((__packed__)) {
+        uint32_t data_len;
+        uint32_t ts_words;
+        int64_t first_ts;
+        double first_value;
+} SeriesHeader;
+
+static inline void
+timestamp_encode_value(BitWriter* writer, uint64_t dod) {
+        uint64_t z = (dod << 1) ^ (uint64_t) ((int64_t) dod >> 63);
+        if (z == 0) {
+                write(writer, 0, 1);
+        } else if (z < (1 << 7)) {
+                write(writer, (0x2 << 7) | z, 2 + 7);
+        } else if (z < (1 << 9)) {
+                write(writer, (0x6 << 9) | z, 3 + 9);
+        } else if (z < (1 << 12)) {
+                write(writer, (0xe << 12) | z, 4 + 12);
+        } else {
+                write(writer, 0xf, 4);
+                writeLong(writer, z, 64);
+        }
+}
+
+static inline uint64_t
+timestamp_decode_value(BitReader* reader) {
+        uint64_t flag = peek(reader, 4);
+        uint64_t z;
+        if (flag < 0x8) {
+                forward(reader, 1);
+                return 0;
+        } else if (flag < 0xc) {
+                forward(reader, 2);
+                z = peek(reader, 7);
+                forward(reader, 7);
+        } else if (flag < 0xe) {
+                forward(reader, 3);
+                z = peek(reader, 9);
+                forward(reader, 9);
+        } else if (flag == 0xe) {
+                forward(reader, 4);
+                z = peek(reader, 12);
+                forward(reader, 12);
+        } else {
+                forward(reader, 4);
+                z = readLong(reader, 64);
+        }
+        return (z >> 1) ^ -(z & 1);
+}
+
+/**
+ * In-place inclusive prefix sum (wrapping), two lanes at a time.
+ */
+static inline void
+prefix_sum(uint64_t* a, ssize_t n) {
+        ssize_t i = 0;
+        uint64_t carry = 0;
+#ifdef __SSE2__
+        __m128i c = _mm_setzero_si128();
+        for (; i + 2 <= n; i += 2) {
+                __m128i v = _mm_loadu_si128((const __m128i*) (a + i));
+                v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+                v = _mm_add_epi64(v, c);
+                _mm_storeu_si128((__m128i*) (a + i), v);
+                c = _mm_shuffle_epi32(v, 0xee);
+        }
+        carry = i ? a[i-1] : 0;
+#endif
+        for (; i < n; i++) {
+                carry += a[i];
+                a[i] = carry;
+        }
+}
+
+/**
+ * `out` holds the first timestamp followed by n-1 delta-of-deltas,
+ * two prefix sums turn them into timestamps.
+ */
+static inline void
+timestamp_integrate(int64_t* out, ssize_t n) {
+        prefix_sum((uint64_t*) out + 1, n - 1);
+        prefix_sum((uint64_t*) out, n);
+}
+
+static inline void
+timestamp_encode_stream(BitWriter* writer, int64_t* in, ssize_t len) {
+        uint64_t* data = (uint64_t*) in;
+        uint64_t prevDelta = 0;
+        for (int i = 1; i < len; i++) {
+                uint64_t delta = data[i] - data[i-1];
+                timestamp_encode_value(writer, delta - prevDelta);
+                prevDelta = delta;
+        }
+}
+
+ssize_t timestamp_encode(int64_t* in, ssize_t len, uint8_t** out) {
+        size_t buffer_size = SIZE_IN_BIT(TS_MAX_BITS * len) * 4;
+        *out = (uint8_t*) malloc(sizeof(TimestampHeader) + buffer_size);
+        TimestampHeader* header = (TimestampHeader*) *out;
+        header->data_len = len;
+        header->first = len ? in[0] : 0;
+        if (len <= 1) {
+                return sizeof(TimestampHeader);
+        }
+        BitWriter writer;
+        initBitWriter(&writer, (uint32_t*) (*out + sizeof(TimestampHeader)), buffer_size / 4);
+        timestamp_encode_stream(&writer, in, len);
+        return sizeof(TimestampHeader) + flush(&writer) * 4;
+}
+
+ssize_t timestamp_decode(uint8_t* in, ssize_t len, int64_t* out) {
+        TimestampHeader* header = (TimestampHeader*) in;
+        ssize_t words = (len - sizeof(TimestampHeader)) / 4;
+        if (header->data_len == 0) {
+                return 0;
+        }
+        out[0] = header->first;
+        if (words == 0) {
+                return header->data_len;
+        }
+        BitReader reader;
+        initBitReader(&reader, (uint32_t*) (in + sizeof(TimestampHeader)), words);
+        uint64_t* data = (uint64_t*) out;
+        for (int i = 1; i < header->data_len; i++) {
+                data[i] = timestamp_decode_value(&reader);
+        }
+        timestamp_integrate(out, header->data_len);
+        return header->data_len;
+}
+
+ssize_t series_encode(int64_t* ts, double* values, ssize_t len, uint8_t** out) {
+        size_t ts_size = SIZE_IN_BIT(TS_MAX_BITS * len) * 4;
+        size_t value_size = SIZE_IN_BIT((1 + 1 + 5 + 6 + 64) * len) * 4;
+        *out = (uint8_t*) malloc(sizeof(SeriesHeader) + ts_size + value_size);
+        SeriesHeader* header = (SeriesHeader*) *out;
+        header->data_len = len;
+        header->ts_words = 0;
+        header->first_ts = len ? ts[0] : 0;
+        header->first_value = len ? values[0] : 0;
+        if (len <= 1) {
+                return sizeof(SeriesHeader);
+        }
+        uint32_t* payload = (uint32_t*) (*out + sizeof(SeriesHeader));
+
+        BitWriter writer;
+        initBitWriter(&writer, payload, ts_size / 4);
+        timestamp_encode_stream(&writer, ts, len);
+        header->ts_words = flush(&writer);
+
+        initBitWriter(&writer, payload + header->ts_words, value_size / 4);
+        GorillaEncoder enc;
+        gorilla_encoder_init(&enc);
+        uint64_t* data = (uint64_t*) values;
+        for (int i = 1; i < len; i++) {
+                gorilla_encode_value(&writer, &enc, data[i-1], data[i]);
+        }
+        return sizeof(SeriesHeader) + (header->ts_words + flush(&writer)) * 4;
+}
+
+ssize_t series_decode(uint8_t* in, ssize_t len, int64_t* ts, double* values) {
+        SeriesHeader* header = (SeriesHeader*) in;
+        ssize_t value_words = (len - sizeof(SeriesHeader)) / 4 - header->ts_words;
+        if (header->data_len == 0) {
+                return 0;
+        }
+        ts[0] = header->first_ts;
+        values[0] = header->first_value;
+        if (header->data_len == 1) {
+                return 1;
+        }
+        uint32_t* payload = (uint32_t*) (in + sizeof(SeriesHeader));
+
+        BitReader ts_reader, value_reader;
+        initBitReader(&ts_reader, payload, header->ts_words);
+        initBitReader(&value_reader, payload + header->ts_words, value_words);
+        GorillaDecoder dec;
+
+        // the two bit streams are independent, so interleaving them gives the
+        // out-of-order core two dependency chains to overlap.
+        uint64_t* ts_data = (uint64_t*) ts;
+        uint64_t* value_data = (uint64_t*) values;
+        for (int i = 1; i < header->data_len; i++) {
+                ts_data[i] = timestamp_decode_value(&ts_reader);
+                value_data[i] = gorilla_decode_value(&value_reader, &dec, value_data[i-1]);
+        }
+        timestamp_integrate(ts, header->data_len);
+        return header->data_len;
+}
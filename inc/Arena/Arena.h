@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bump allocator for per-block codec scratch memory.
+// A thread binds its arena with arena_bind(); codecs then take their scratch buffers from
+// it through scratch_alloc() and give everything back when the block is done (ArenaScope).
+// With no arena bound scratch_alloc()/scratch_free() fall back to malloc()/free().
+// Buffers returned to the caller (the compressed block, the decoded values) are always malloc'd.
+
+#define ARENA_ALIGN             16
+#define ARENA_MIN_CHUNK         (64 * 1024)
+
+typedef struct ArenaChunk {
+        struct ArenaChunk* prev;
+        size_t size;
+        size_t used;
+        alignas(ARENA_ALIGN) uint8_t data[0];
+} ArenaChunk;
+
+typedef struct {
+        ArenaChunk* head;
+        // chunk kept across rewinds, the largest one the rewinds released
+        ArenaChunk* spare;
+        // chunks malloc'd so far
+        size_t chunks;
+} Arena;
+
+typedef struct {
+        ArenaChunk* chunk;
+        size_t used;
+} ArenaMark;
+
+static inline void
+arena_init(Arena* arena) {
+        arena->head = NULL;
+        arena->spare = NULL;
+        arena->chunks = 0;
+}
+
+static inline ArenaChunk*
+arena_new_chunk(size_t size) {
+        ArenaChunk* chunk = (ArenaChunk*) malloc(sizeof(ArenaChunk) + size);
+        chunk->prev = NULL;
+        chunk->size = size;
+        chunk->used = 0;
+        return chunk;
+}
+
+static inline void*
+arena_alloc(Arena* arena, size_t bytes) {
+        bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+        ArenaChunk* head = arena->head;
+        if (__builtin_expect(head == NULL || head->used + bytes > head->size, 0)) {
+                ArenaChunk* chunk;
+                if (arena->spare && arena->spare->size >= bytes) {
+                        chunk = arena->spare;
+                        arena->spare = NULL;
+                } else {
+                        size_t size = head ? head->size * 2 : ARENA_MIN_CHUNK;
+                        chunk = arena_new_chunk(size > bytes ? size : bytes);
+                        arena->chunks++;
+                }
+                chunk->prev = head;
+                chunk->used = 0;
+                arena->head = head = chunk;
+        }
+        void* p = head->data + head->used;
+        head->used += bytes;
+        return p;
+}
+
+static inline ArenaMark
+arena_mark(Arena* arena) {
+        ArenaMark mark = {arena->head, arena->head ? arena->head->used : 0};
+        return mark;
+}
+
+/**
+ * Release everything allocated since `mark`. The largest chunk opened since is kept
+ * as the spare and the others are freed: chunks double as they are opened, so once the
+ * spare holds a whole block a steady per-block workload stops calling malloc and free.
+ */
+static inline void
+arena_rewind(Arena* arena, ArenaMark mark) {
+        while (arena->head != mark.chunk) {
+                ArenaChunk* chunk = arena->head;
+                arena->head = chunk->prev;
+                if (arena->spare == NULL || arena->spare->size < chunk->size) {
+                        free(arena->spare);
+                        arena->spare = chunk;
+                } else {
+                        free(chunk);
+                }
+        }
+        if (arena->head) {
+                arena->head->used = mark.used;
+        }
+}
+
+static inline void
+arena_destroy(Arena* arena) {
+        ArenaMark start = {NULL, 0};
+        arena_rewind(arena, start);
+        free(arena->spare);
+        arena->spare = NULL;
+}
+
+/**
+ * The arena bound to the calling thread (shared by all translation units).
+ */
+inline Arena*&
+arena_bound() {
+        static thread_local Arena* arena = NULL;
+        return arena;
+}
+
+/**
+ * Bind `arena` (or NULL) to the calling thread, returns the previously bound one.
+ */
+static inline Arena*
+arena_bind(Arena* arena) {
+        Arena* prev = arena_bound();
+        arena_bound() = arena;
+        return prev;
+}
+
+static inline void*
+scratch_alloc(size_t bytes) {
+        Arena* arena = arena_bound();
+        return arena ? arena_alloc(arena, bytes) : malloc(bytes);
+}
+
+static inline void*
+scratch_calloc(size_t n, size_t size) {
+        Arena* arena = arena_bound();
+        if (arena == NULL) {
+                return calloc(n, size);
+        }
+        void* p = arena_alloc(arena, n * size);
+        memset(p, 0, n * size);
+        return p;
+}
+
+static inline void
+scratch_free(void* p) {
+        if (arena_bound() == NULL) {
+                free(p);
+        }
+}
+
+/**
+ * Gives back the scratch memory of one codec call on scope exit.
+ */
+struct ArenaScope {
+        Arena* arena;
+        ArenaMark mark;
+
+        ArenaScope() : arena(arena_bound()) {
+                if (arena) {
+                        mark = arena_mark(arena);
+                }
+        }
+        ~ArenaScope() {
+                if (arena) {
+                        arena_rewind(arena, mark);
+                }
+        }
+};
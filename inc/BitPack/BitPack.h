@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+// Lane-interleaved bit packing of fixed-width integers, shared by the PFor entropy stage
+// (machete/pfor.cpp) and ALP (alp/alp.cpp). Value j * lanes + l goes to row j of lane l, so
+// every lane shifts by the same amount at the same step and a row is one vector operation
+// (GCC splits it over the SIMD registers of the target).
+// `rows` rows of `width` bits take ceil(rows * width / bits of Word) * lanes words.
+
+template<typename Word, int lanes>
+struct BitPackRow {
+        typedef Word type __attribute__((vector_size(lanes * sizeof(Word)), aligned(sizeof(Word))));
+};
+
+/**
+ * Packs `rows` rows of `lanes` values into `out`, the bits above `width` are dropped.
+ * Inlined into a caller with a constant width and row count, every shift is known and the
+ * row loop unrolls.
+ */
+template<typename Word, int lanes>
+static inline __attribute__((always_inline)) void
+bitpack(const Word* in, Word* out, int width, int rows) {
+        typedef typename BitPackRow<Word, lanes>::type Row;
+        const int bits = 8 * sizeof(Word);
+        const Word mask = width == bits ? ~(Word) 0 : ((Word) 1 << (width & (bits - 1))) - 1;
+        for (int j = 0; j < rows && width > 0; j++) {
+                const int bit = j * width;
+                const int shift = bit & (bits - 1);
+                Row* word = (Row*) (out + bit / bits * lanes);
+                Row v = *(const Row*) (in + j * lanes) & mask;
+                // a word is first written by the value starting at its bit 0 or by a spill
+                if (shift == 0) {
+                        word[0] = v;
+                } else {
+                        word[0] |= v << shift;
+                }
+                if (shift + width > bits) {
+                        word[1] = v >> (bits - shift);
+                }
+        }
+}
+
+/**
+ * Unpacks `rows` rows of `lanes` values of `width` bits from `in`.
+ */
+template<typename Word, int lanes>
+static inline __attribute__((always_inline)) void
+bitunpack(const Word* in, Word* out, int width, int rows) {
+        typedef typename BitPackRow<Word, lanes>::type Row;
+        const int bits = 8 * sizeof(Word);
+        if (width == 0) {
+                for (int j = 0; j < rows; j++) {
+                        *(Row*) (out + j * lanes) = Row{};
+                }
+                return;
+        }
+        const Word mask = width == bits ? ~(Word) 0 : ((Word) 1 << (width & (bits - 1))) - 1;
+        for (int j = 0; j < rows; j++) {
+                const int bit = j * width;
+                const int shift = bit & (bits - 1);
+                const Row* word = (const Row*) (in + bit / bits * lanes);
+                Row* v = (Row*) (out + j * lanes);
+                if (shift + width > bits) {
+                        *v = ((word[0] >> shift) | (word[1] << (bits - shift))) & mask;
+                } else {
+                        *v = (word[0] >> shift) & mask;
+                }
+        }
+}
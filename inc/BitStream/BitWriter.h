@@ -59,6 +59,39 @@ writeLong(BitWriter* writer, uint64_t data, uint64_t length)
         write(writer, data, length);
 }
 
+// One (code, length) pair of write_fields, only the low `len` bits of `code` are written.
+typedef struct {
+        uint64_t code;
+        uint64_t len;
+} BitField;
+
+/**
+ * Packs N fields (first field most significant, at most 64 bits in total) into one
+ * staging value, which then takes one write() for up to 32 bits and two beyond.
+ * With constant lengths the packing folds into a few shifts and ORs.
+ */
+template<int N>
+static inline void
+write_fields(BitWriter* writer, const BitField (&fields)[N])
+{
+        uint64_t code = 0;
+        uint64_t length = 0;
+        for (int i = 0; i < N; i++) {
+                uint64_t len = fields[i].len;
+                uint64_t bits = len ? fields[i].code << (64 - len) >> (64 - len) : 0;
+                code = len < 64 ? (code << len) | bits : bits;
+                length += len;
+        }
+        assert(length <= 64);
+        if (length > 32) {
+                write(writer, code >> 32, length - 32);
+                length = 32;
+        }
+        if (length) {
+                write(writer, code, length);
+        }
+}
+
 static inline int
 flush(BitWriter* writer) {
         if (writer->bitcnt) {
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Hardware counters of the calling thread through perf_event_open(2).
+// Threads it creates after opening them are counted as well, but only once they exit,
+// so the helpers of a thread pool that outlives the measured call (e.g. OpenMP's) are not.
+// Only user space is counted, which the default perf_event_paranoid (2) allows without root.
+// A counter the machine does not provide (e.g. inside a VM) stays closed and is marked missing
+// in the counts it would have added to, see perf_event_valid.
+
+enum PerfEventId {
+        PERF_EV_CYCLES,
+        PERF_EV_INSTRUCTIONS,
+        PERF_EV_BRANCH_MISSES,
+        PERF_EV_L1D_MISSES,
+        PERF_EV_LLC_MISSES,
+        PERF_EV_COUNT,
+};
+
+static const char* const perf_event_names[PERF_EV_COUNT] = {
+        "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+};
+
+typedef struct {
+        int fd[PERF_EV_COUNT];
+} PerfEvents;
+
+typedef struct {
+        uint64_t count[PERF_EV_COUNT];
+        // bit i is set once counter i was closed or unreadable in a perf_events_stop,
+        // its count then leaves out some of the calls
+        uint32_t missing;
+} PerfCounts;
+
+/**
+ * Opens every counter that is available.
+ * @return The number of counters opened.
+ */
+static inline int
+perf_events_open(PerfEvents* events) {
+        static const struct {
+                uint32_t type;
+                uint64_t config;
+        } kinds[PERF_EV_COUNT] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        };
+        int opened = 0;
+        for (int i = 0; i < PERF_EV_COUNT; i++) {
+                struct perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = kinds[i].type;
+                attr.config = kinds[i].config;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.inherit = 1;
+                // the PMU may multiplex the counters, the enabled/running times scale them back
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                events->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+                opened += events->fd[i] >= 0;
+        }
+        return opened;
+}
+
+/**
+ * Whether counter `id` counted every call added to `counts`.
+ */
+static inline bool
+perf_event_valid(const PerfCounts* counts, int id) {
+        return !(counts->missing & 1U << id);
+}
+
+static inline void
+perf_events_start(PerfEvents* events) {
+        for (int i = 0; i < PERF_EV_COUNT; i++) {
+                if (events->fd[i] >= 0) {
+                        ioctl(events->fd[i], PERF_EVENT_IOC_RESET, 0);
+                        ioctl(events->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+                }
+        }
+}
+
+/**
+ * Stops the counters and adds what they counted since perf_events_start to `counts`.
+ */
+static inline void
+perf_events_stop(PerfEvents* events, PerfCounts* counts) {
+        for (int i = 0; i < PERF_EV_COUNT; i++) {
+                if (events->fd[i] >= 0) {
+                        ioctl(events->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+                }
+        }
+        for (int i = 0; i < PERF_EV_COUNT; i++) {
+                uint64_t value[3];
+                if (events->fd[i] < 0 || read(events->fd[i], value, sizeof(value)) != sizeof(value)) {
+                        counts->missing |= 1U << i;
+                        continue;
+                }
+                if (value[2] > 0 && value[2] < value[1]) {
+                        value[0] = (double) value[0] * value[1] / value[2];
+                }
+                counts->count[i] += value[0];
+        }
+}
+
+static inline void
+perf_events_close(PerfEvents* events) {
+        for (int i = 0; i < PERF_EV_COUNT; i++) {
+                if (events->fd[i] >= 0) {
+                        close(events->fd[i]);
+                        events->fd[i] = -1;
+                }
+        }
+}
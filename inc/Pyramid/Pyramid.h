@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+// Summary pyramid: the min, max, first and last value of every `span` values of a block,
+// then of every PYRAMID_FANOUT buckets of the level below, up to a level of one bucket.
+// It is appended to the compressed block as a trailer, like the zone maps (inc/ZoneMap/ZoneMap.h),
+// so a zoomed-out read takes a level of buckets without decoding the block, whatever the codec.
+// Buckets are floats to keep the layer small: min is rounded down and max up so they still
+// bound the values, first and last are rounded to the nearest float.
+//
+//      compressed block
+//      the buckets of every level, the finest first
+//      len (uint32_t), span (uint16_t), PYRAMID_FANOUT (uint16_t)
+//      PYRAMID_MAGIC (uint32_t)
+
+#define PYRAMID_MAGIC           0x31525950U     // "PYR1"
+#define PYRAMID_FANOUT          4
+#define PYRAMID_TRAILER_SIZE    (3 * sizeof(uint32_t))
+#define PYRAMID_MAX_LEVELS      64
+
+typedef struct {
+        float min;
+        float max;
+        float first;
+        float last;
+} PyramidBucket;
+
+typedef ssize_t (*PyramidCompress) (double* in, ssize_t len, uint8_t** out, double error);
+typedef ssize_t (*PyramidDecompress) (uint8_t* in, ssize_t size, double* out, double error);
+
+/**
+ * Number of buckets of every level for `len` values, returns the number of levels,
+ * or -1 if `span` and `fanout` do not make a pyramid of at most PYRAMID_MAX_LEVELS levels.
+ */
+static inline int
+pyramid_levels(ssize_t len, ssize_t span, ssize_t fanout, ssize_t* count) {
+        if (span < 1 || fanout < 2) {
+                return -1;
+        }
+        int levels = 0;
+        ssize_t n = (len + span - 1) / span;
+        count[levels++] = n;
+        while (n > 1) {
+                if (levels == PYRAMID_MAX_LEVELS) {
+                        return -1;
+                }
+                n = (n + fanout - 1) / fanout;
+                count[levels++] = n;
+        }
+        return levels;
+}
+
+static inline float
+pyramid_round_down(double v) {
+        float f = (float) v;
+        return f > v ? nextafterf(f, -INFINITY) : f;
+}
+
+static inline float
+pyramid_round_up(double v) {
+        float f = (float) v;
+        return f < v ? nextafterf(f, INFINITY) : f;
+}
+
+/**
+ * Writes the buckets of every level of `len` values to `out`, the finest level first.
+ * NaNs are left out of min and max, a bucket of NaNs only has min > max.
+ */
+static inline void
+pyramid_build(const double* in, ssize_t len, ssize_t span, PyramidBucket* out) {
+        ssize_t count[PYRAMID_MAX_LEVELS];
+        int levels = pyramid_levels(len, span, PYRAMID_FANOUT, count);
+        for (ssize_t b = 0; b < count[0]; b++) {
+                const double* v = in + b * span;
+                ssize_t n = len - b * span < span ? len - b * span : span;
+                double min = INFINITY, max = -INFINITY;
+                for (ssize_t i = 0; i < n; i++) {
+                        min = v[i] < min ? v[i] : min;
+                        max = v[i] > max ? v[i] : max;
+                }
+                out[b].min = pyramid_round_down(min);
+                out[b].max = pyramid_round_up(max);
+                out[b].first = (float) v[0];
+                out[b].last = (float) v[n - 1];
+        }
+        for (int l = 1; l < levels; l++) {
+                const PyramidBucket* fine = out;
+                out += count[l - 1];
+                for (ssize_t b = 0; b < count[l]; b++) {
+                        const PyramidBucket* f = fine + b * PYRAMID_FANOUT;
+                        ssize_t n = count[l - 1] - b * PYRAMID_FANOUT < PYRAMID_FANOUT ? count[l - 1] - b * PYRAMID_FANOUT : PYRAMID_FANOUT;
+                        out[b] = f[0];
+                        for (ssize_t i = 1; i < n; i++) {
+                                out[b].min = f[i].min < out[b].min ? f[i].min : out[b].min;
+                                out[b].max = f[i].max > out[b].max ? f[i].max : out[b].max;
+                        }
+                        out[b].last = f[n - 1].last;
+                }
+        }
+}
+
+/**
+ * Appends the pyramid of `len` values with buckets of `span` values (at most 65535)
+ * to the malloc'd block `*out` of `size` bytes, returns the new size.
+ */
+static inline ssize_t
+pyramid_append(uint8_t** out, ssize_t size, const double* in, ssize_t len, ssize_t span) {
+        ssize_t count[PYRAMID_MAX_LEVELS];
+        int levels = pyramid_levels(len, span, PYRAMID_FANOUT, count);
+        ssize_t buckets = 0;
+        for (int l = 0; l < levels; l++) {
+                buckets += count[l];
+        }
+        ssize_t bucket_size = buckets * sizeof(PyramidBucket);
+        *out = (uint8_t*) realloc(*out, size + bucket_size + PYRAMID_TRAILER_SIZE);
+        PyramidBucket* pyramid = (PyramidBucket*) malloc(bucket_size);
+        pyramid_build(in, len, span, pyramid);
+        // the block may end at any byte, the layer is copied rather than built in place
+        memcpy(*out + size, pyramid, bucket_size);
+        free(pyramid);
+        uint32_t tail[3] = {(uint32_t) len, (uint32_t) (span | PYRAMID_FANOUT << 16), PYRAMID_MAGIC};
+        memcpy(*out + size + bucket_size, tail, sizeof(tail));
+        return size + bucket_size + PYRAMID_TRAILER_SIZE;
+}
+
+/**
+ * Size in bytes of the pyramid at the end of a block of `size` bytes, 0 if it has none,
+ * -1 if its trailer is corrupt (a bad span or fanout, or a layer larger than the block).
+ */
+static inline ssize_t
+pyramid_size(const uint8_t* in, ssize_t size) {
+        uint32_t tail[3];
+        if (size < (ssize_t) PYRAMID_TRAILER_SIZE) {
+                return 0;
+        }
+        memcpy(tail, in + size - sizeof(tail), sizeof(tail));
+        if (tail[2] != PYRAMID_MAGIC) {
+                return 0;
+        }
+        ssize_t count[PYRAMID_MAX_LEVELS];
+        int levels = pyramid_levels(tail[0], tail[1] & 0xffff, tail[1] >> 16, count);
+        if (levels < 0) {
+                return -1;
+        }
+        ssize_t buckets = 0;
+        for (int l = 0; l < levels; l++) {
+                buckets += count[l];
+        }
+        ssize_t layer = buckets * sizeof(PyramidBucket) + PYRAMID_TRAILER_SIZE;
+        return layer > size ? -1 : layer;
+}
+
+/**
+ * Reads the finest level of the pyramid of a block that has at most `points` buckets
+ * (the coarsest one if none has) into `out`, without decoding the block. `*span` is set to
+ * the number of values per bucket, the last bucket may have fewer.
+ * Returns the number of buckets, 0 if the block has no pyramid, -1 if it is corrupt.
+ */
+static inline ssize_t
+pyramid_read(const uint8_t* in, ssize_t size, ssize_t points, PyramidBucket* out, ssize_t* span) {
+        ssize_t layer = pyramid_size(in, size);
+        if (layer <= 0) {
+                return layer;
+        }
+        uint32_t tail[3];
+        memcpy(tail, in + size - sizeof(tail), sizeof(tail));
+        ssize_t fanout = tail[1] >> 16;
+        ssize_t count[PYRAMID_MAX_LEVELS];
+        int levels = pyramid_levels(tail[0], tail[1] & 0xffff, fanout, count);
+        const uint8_t* level = in + size - layer;
+        *span = tail[1] & 0xffff;
+        int l = 0;
+        for (; l + 1 < levels && count[l] > points; l++) {
+                level += count[l] * sizeof(PyramidBucket);
+                *span *= fanout;
+        }
+        memcpy(out, level, count[l] * sizeof(PyramidBucket));
+        return count[l];
+}
+
+/**
+ * Compresses `in` with `compress` and appends the pyramid of the block.
+ */
+static inline ssize_t
+pyramid_compress(double* in, ssize_t len, uint8_t** out, double error, PyramidCompress compress, ssize_t span) {
+        ssize_t size = compress(in, len, out, error);
+        return pyramid_append(out, size, in, len, span);
+}
+
+/**
+ * Decompresses a block written by pyramid_compress, `decompress` is given the block without the pyramid.
+ */
+static inline ssize_t
+pyramid_decompress(uint8_t* in, ssize_t size, double* out, double error, PyramidDecompress decompress) {
+        ssize_t layer = pyramid_size(in, size);
+        if (layer <= 0) {
+                return -1;
+        }
+        return decompress(in, size - layer, out, error);
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Blosc-style transposition of 8-byte values, placed in front of general-purpose codecs.
+// Byte shuffle groups byte j of every value into stream j, so the highly redundant
+// sign/exponent bytes are no longer interleaved with mantissa noise.
+// Bit shuffle further splits every byte stream into its 8 bit planes.
+// Optionally each value is first replaced by its XOR with (or delta to) its predecessor.
+
+enum ShuffleMode {
+        SHUFFLE_NONE    = 0,
+        SHUFFLE_BYTE    = 1,
+        SHUFFLE_BIT     = 2,
+        SHUFFLE_XOR     = 1 << 2,
+        SHUFFLE_DELTA   = 2 << 2,
+};
+
+#define SHUFFLE_LAYOUT(mode)    ((mode) & 0x3)
+#define SHUFFLE_PRE(mode)       ((mode) & 0xc)
+
+#ifdef __SSE2__
+// Transpose an 8x8 matrix of 16-bit lanes held in r[0..7]; the transposition is its own inverse.
+static inline void
+transpose_epi16(__m128i* r) {
+        __m128i s0 = _mm_unpacklo_epi16(r[0], r[1]);
+        __m128i s1 = _mm_unpackhi_epi16(r[0], r[1]);
+        __m128i s2 = _mm_unpacklo_epi16(r[2], r[3]);
+        __m128i s3 = _mm_unpackhi_epi16(r[2], r[3]);
+        __m128i s4 = _mm_unpacklo_epi16(r[4], r[5]);
+        __m128i s5 = _mm_unpackhi_epi16(r[4], r[5]);
+        __m128i s6 = _mm_unpacklo_epi16(r[6], r[7]);
+        __m128i s7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+        __m128i t0 = _mm_unpacklo_epi32(s0, s2);
+        __m128i t1 = _mm_unpackhi_epi32(s0, s2);
+        __m128i t2 = _mm_unpacklo_epi32(s1, s3);
+        __m128i t3 = _mm_unpackhi_epi32(s1, s3);
+        __m128i t4 = _mm_unpacklo_epi32(s4, s6);
+        __m128i t5 = _mm_unpackhi_epi32(s4, s6);
+        __m128i t6 = _mm_unpacklo_epi32(s5, s7);
+        __m128i t7 = _mm_unpackhi_epi32(s5, s7);
+
+        r[0] = _mm_unpacklo_epi64(t0, t4);
+        r[1] = _mm_unpackhi_epi64(t0, t4);
+        r[2] = _mm_unpacklo_epi64(t1, t5);
+        r[3] = _mm_unpackhi_epi64(t1, t5);
+        r[4] = _mm_unpacklo_epi64(t2, t6);
+        r[5] = _mm_unpackhi_epi64(t2, t6);
+        r[6] = _mm_unpacklo_epi64(t3, t7);
+        r[7] = _mm_unpackhi_epi64(t3, t7);
+}
+
+// Interleave the two 8-byte halves of a vector; applying it four times is the identity.
+static inline __m128i
+interleave_halves(__m128i v) {
+        return _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+}
+#endif
+
+/**
+ * out[j*n + i] = byte j of value i
+ */
+static inline void
+byte_shuffle(const uint8_t* in, size_t n, uint8_t* out) {
+        size_t i = 0;
+#ifdef __SSE2__
+        // 16 values (8 vectors) at a time: pair up the bytes of neighbouring values,
+        // then an 8x8 transpose of the 16-bit pairs yields one vector per byte stream.
+        for (; i + 16 <= n; i += 16) {
+                __m128i r[8];
+                for (int k = 0; k < 8; k++) {
+                        r[k] = interleave_halves(_mm_loadu_si128((const __m128i*) (in + i * 8 + k * 16)));
+                }
+                transpose_epi16(r);
+                for (int j = 0; j < 8; j++) {
+                        _mm_storeu_si128((__m128i*) (out + j * n + i), r[j]);
+                }
+        }
+#endif
+        for (; i < n; i++) {
+                for (int j = 0; j < 8; j++) {
+                        out[j * n + i] = in[i * 8 + j];
+                }
+        }
+}
+
+static inline void
+byte_unshuffle(const uint8_t* in, size_t n, uint8_t* out) {
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+                __m128i r[8];
+                for (int j = 0; j < 8; j++) {
+                        r[j] = _mm_loadu_si128((const __m128i*) (in + j * n + i));
+                }
+                transpose_epi16(r);
+                for (int k = 0; k < 8; k++) {
+                        __m128i v = interleave_halves(interleave_halves(interleave_halves(r[k])));
+                        _mm_storeu_si128((__m128i*) (out + i * 8 + k * 16), v);
+                }
+        }
+#endif
+        for (; i < n; i++) {
+                for (int j = 0; j < 8; j++) {
+                        out[i * 8 + j] = in[j * n + i];
+                }
+        }
+}
+
+/**
+ * Transpose an 8x8 bit matrix stored as 8 bytes (Hacker's Delight 7-3),
+ * the transposition is its own inverse.
+ */
+static inline uint64_t
+transpose_bits8x8(uint64_t x) {
+        uint64_t t;
+        t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+        x = x ^ t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+        x = x ^ t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+        x = x ^ t ^ (t << 28);
+        return x;
+}
+
+/**
+ * Split every byte stream of a byte-shuffled buffer into 8 bit planes of n/8 bytes.
+ * Only the first n & ~7 values are bit-transposed, the remaining bytes of
+ * every stream are stored after its planes.
+ */
+static inline void
+bit_planes(const uint8_t* in, size_t n, uint8_t* out) {
+        size_t n8 = n & ~(size_t) 7;
+        for (int j = 0; j < 8; j++) {
+                const uint8_t* stream = in + j * n;
+                uint8_t* planes = out + j * n;
+                for (size_t i = 0; i < n8; i += 8) {
+                        uint64_t x;
+                        memcpy(&x, stream + i, 8);
+                        x = transpose_bits8x8(x);
+                        for (int p = 0; p < 8; p++) {
+                                planes[p * (n8 / 8) + i / 8] = x >> (p * 8);
+                        }
+                }
+                memcpy(planes + n8, stream + n8, n - n8);
+        }
+}
+
+static inline void
+bit_unplanes(const uint8_t* in, size_t n, uint8_t* out) {
+        size_t n8 = n & ~(size_t) 7;
+        for (int j = 0; j < 8; j++) {
+                const uint8_t* planes = in + j * n;
+                uint8_t* stream = out + j * n;
+                for (size_t i = 0; i < n8; i += 8) {
+                        uint64_t x = 0;
+                        for (int p = 0; p < 8; p++) {
+                                x |= (uint64_t) planes[p * (n8 / 8) + i / 8] << (p * 8);
+                        }
+                        x = transpose_bits8x8(x);
+                        memcpy(stream + i, &x, 8);
+                }
+                memcpy(stream + n8, planes + n8, n - n8);
+        }
+}
+
+/**
+ * Apply the predecessor transform and the shuffle layout of `mode` to `n` values.
+ * `out` and `tmp` must both hold n * 8 bytes.
+ */
+static inline void
+shuffle_encode(const double* in, size_t n, uint8_t* out, uint8_t* tmp, int mode) {
+        const uint8_t* src = (const uint8_t*) in;
+        if (SHUFFLE_PRE(mode)) {
+                // the bit shuffle needs `tmp` for the byte-shuffled streams
+                uint64_t* pre = (uint64_t*) (SHUFFLE_LAYOUT(mode) == SHUFFLE_BYTE ? tmp : out);
+                uint64_t prev = 0;
+                for (size_t i = 0; i < n; i++) {
+                        uint64_t v = ((const uint64_t*) in)[i];
+                        pre[i] = SHUFFLE_PRE(mode) == SHUFFLE_XOR ? v ^ prev : v - prev;
+                        prev = v;
+                }
+                src = (const uint8_t*) pre;
+        }
+        switch (SHUFFLE_LAYOUT(mode)) {
+                case SHUFFLE_BYTE:
+                        byte_shuffle(src, n, out);
+                        break;
+                case SHUFFLE_BIT:
+                        byte_shuffle(src, n, tmp);
+                        bit_planes(tmp, n, out);
+                        break;
+                default:
+                        if (src != out) {
+                                memcpy(out, src, n * 8);
+                        }
+                        break;
+        }
+}
+
+/**
+ * Inverse of shuffle_encode, `tmp` must hold n * 8 bytes.
+ */
+static inline void
+shuffle_decode(const uint8_t* in, size_t n, double* out, uint8_t* tmp, int mode) {
+        switch (SHUFFLE_LAYOUT(mode)) {
+                case SHUFFLE_BYTE:
+                        byte_unshuffle(in, n, (uint8_t*) out);
+                        break;
+                case SHUFFLE_BIT:
+                        bit_unplanes(in, n, tmp);
+                        byte_unshuffle(tmp, n, (uint8_t*) out);
+                        break;
+                default:
+                        memcpy(out, in, n * 8);
+                        break;
+        }
+        if (SHUFFLE_PRE(mode)) {
+                uint64_t* data = (uint64_t*) out;
+                uint64_t prev = 0;
+                for (size_t i = 0; i < n; i++) {
+                        prev = SHUFFLE_PRE(mode) == SHUFFLE_XOR ? data[i] ^ prev : data[i] + prev;
+                        data[i] = prev;
+                }
+        }
+}
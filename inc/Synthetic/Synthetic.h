@@ -0,0 +1,214 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Deterministic synthetic series, so codecs can be measured without external data.
+// The same SynthSpec always yields the same values (the PRNG is splitmix64, not rand()).
+// synth_open exposes a series as a read-only FILE* of doubles generated on the fly,
+// so even 1B-point series take no memory; seeking backwards restarts the generator.
+
+enum SynthKind {
+        SYNTH_NONE,
+        SYNTH_RANDOM_WALK,      // x += noise * N(0,1)
+        SYNTH_SINE,             // 100 sin(2 pi i / SYNTH_PERIOD) + noise * N(0,1)
+        SYNTH_STEP,             // a level that jumps every ~SYNTH_PERIOD/4 values, plus noise
+        SYNTH_COUNTER,          // a monotonic integer counter with increments in [1, 1 + 2 noise]
+        SYNTH_GPS,              // the latitude of a trajectory with a slowly turning heading
+        SYNTH_PRICE,            // a geometric random walk, x *= exp(noise * N(0,1))
+        SYNTH_CONSTANT,         // constant runs of 1 to SYNTH_PERIOD/2 values
+};
+
+#define SYNTH_PERIOD    1024
+
+typedef struct {
+        SynthKind kind;
+        int64_t len;            // number of values
+        int precision;          // decimal digits kept after rounding, -1 for full precision
+        double noise;
+        uint64_t seed;
+} SynthSpec;
+
+typedef struct {
+        SynthSpec spec;
+        int64_t index;          // values generated so far
+        uint64_t rng;
+        double x;               // current value (before noise and rounding)
+        double heading;
+        int64_t run;            // values left in the current run
+        double pending;         // value being read, `consumed` of its bytes are already out
+        int consumed;
+} SynthStream;
+
+static inline uint64_t
+synth_rand(SynthStream* s) {
+        uint64_t z = (s->rng += 0x9e3779b97f4a7c15UL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+        return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static inline double
+synth_uniform(SynthStream* s) {
+        return (synth_rand(s) >> 11) * 0x1.0p-53;
+}
+
+static inline double
+synth_gauss(SynthStream* s) {
+        double u = 1.0 - synth_uniform(s);
+        return sqrt(-2.0 * log(u)) * cos(2 * M_PI * synth_uniform(s));
+}
+
+static inline void
+synth_reset(SynthStream* s) {
+        s->index = 0;
+        s->rng = s->spec.seed;
+        s->run = 0;
+        s->consumed = 0;
+        s->heading = 0;
+        switch (s->spec.kind) {
+        case SYNTH_GPS: s->x = 39.9; break;
+        case SYNTH_COUNTER: s->x = 0; break;
+        default: s->x = 100; break;
+        }
+}
+
+static inline void
+synth_init(SynthStream* s, const SynthSpec* spec) {
+        s->spec = *spec;
+        synth_reset(s);
+}
+
+static inline double
+synth_next(SynthStream* s) {
+        double noise = s->spec.noise;
+        double v;
+        switch (s->spec.kind) {
+        case SYNTH_RANDOM_WALK:
+                s->x += noise * synth_gauss(s);
+                v = s->x;
+                break;
+        case SYNTH_SINE:
+                v = 100 * sin(2 * M_PI * s->index / SYNTH_PERIOD) + noise * synth_gauss(s);
+                break;
+        case SYNTH_STEP:
+                if (synth_rand(s) % (SYNTH_PERIOD / 4) == 0) {
+                        s->x += 10 * synth_gauss(s);
+                }
+                v = s->x + noise * synth_gauss(s);
+                break;
+        case SYNTH_COUNTER:
+                s->x += 1 + floor(synth_uniform(s) * (2 * noise + 1));
+                v = s->x;
+                break;
+        case SYNTH_GPS:
+                // about 1e-5 degrees (1 m) per sample
+                s->heading += 0.05 * synth_gauss(s);
+                s->x += 1e-5 * (1 + noise * synth_gauss(s)) * cos(s->heading);
+                v = s->x;
+                break;
+        case SYNTH_PRICE:
+                s->x *= exp(noise * synth_gauss(s));
+                v = s->x;
+                break;
+        case SYNTH_CONSTANT:
+                if (s->run == 0) {
+                        s->run = 1 + synth_rand(s) % (SYNTH_PERIOD / 2);
+                        s->x = 100 + 100 * noise * synth_gauss(s);
+                }
+                s->run--;
+                v = s->x;
+                break;
+        default:
+                v = 0;
+                break;
+        }
+        s->index++;
+        if (s->spec.precision >= 0) {
+                double scale = pow(10, s->spec.precision);
+                v = round(v * scale) / scale;
+        }
+        return v;
+}
+
+/**
+ * Fills `out` with the next `len` values.
+ */
+static inline void
+synth_fill(SynthStream* s, double* out, int64_t len) {
+        for (int64_t i = 0; i < len; i++) {
+                out[i] = synth_next(s);
+        }
+}
+
+//////////////////////////////// FILE* interface ////////////////////////////////
+
+static ssize_t
+synth_cookie_read(void* cookie, char* buf, size_t size) {
+        SynthStream* s = (SynthStream*) cookie;
+        size_t done = 0;
+        while (done < size && (s->consumed || s->index < s->spec.len)) {
+                if (s->consumed == 0 && size - done >= sizeof(double)) {
+                        double v = synth_next(s);
+                        memcpy(buf + done, &v, sizeof(double));
+                        done += sizeof(double);
+                        continue;
+                }
+                if (s->consumed == 0) {
+                        s->pending = synth_next(s);
+                }
+                size_t n = sizeof(double) - s->consumed;
+                n = n < size - done ? n : size - done;
+                memcpy(buf + done, (char*) &s->pending + s->consumed, n);
+                done += n;
+                s->consumed = (s->consumed + n) % sizeof(double);
+        }
+        return done;
+}
+
+static int
+synth_cookie_seek(void* cookie, off64_t* offset, int whence) {
+        SynthStream* s = (SynthStream*) cookie;
+        int64_t pos = s->index * sizeof(double) - (s->consumed ? sizeof(double) - s->consumed : 0);
+        int64_t target = *offset;
+        if (whence == SEEK_CUR) {
+                target += pos;
+        } else if (whence == SEEK_END) {
+                target += s->spec.len * sizeof(double);
+        }
+        if (target < 0 || target > s->spec.len * (int64_t) sizeof(double) || target % sizeof(double)) {
+                return -1;
+        }
+        if (target < pos) {
+                synth_reset(s);
+        }
+        // the generators are sequential, moving forward regenerates the skipped values
+        while (s->index * (int64_t) sizeof(double) < target) {
+                synth_next(s);
+        }
+        s->consumed = 0;
+        *offset = target;
+        return 0;
+}
+
+static int
+synth_cookie_close(void* cookie) {
+        free(cookie);
+        return 0;
+}
+
+/**
+ * Opens the series as a binary stream of doubles, close it with fclose.
+ * Offsets passed to fseek must be multiples of sizeof(double).
+ */
+static inline FILE*
+synth_open(const SynthSpec* spec) {
+        SynthStream* s = (SynthStream*) malloc(sizeof(SynthStream));
+        synth_init(s, spec);
+        cookie_io_functions_t io = {synth_cookie_read, NULL, synth_cookie_seek, synth_cookie_close};
+        return fopencookie(s, "rb", io);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+// Error-bounded mantissa truncation, the lossy mode of the XOR codecs (Gorilla, Chimp).
+// Every value loses as many low mantissa bits as it can while staying within `error`,
+// so the XORs of consecutive values end in long runs of zeros. The result is an ordinary
+// series of doubles: the lossless encoders code it and their decoders read it unchanged.
+
+/**
+ * Clears the most low mantissa bits of `v` that keep |v - v'| <= error,
+ * `error_exp` is ilogb(error). Infinities and NaNs are kept as is.
+ */
+static inline double
+truncate_value(double v, double error, int error_exp) {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        int exp = (bits >> 52) & 0x7ff;
+        if (exp == 0x7ff) {
+                return v;
+        }
+        // clearing k bits moves v by less than 2^(k + exp - 1075), subnormals scale like exp 1;
+        // the check below catches an error bound that is not a power of two
+        int k = error_exp + 1075 - (exp ? exp : 1);
+        for (k = k > 52 ? 52 : k; k > 0; k--) {
+                uint64_t t = bits & ~((1UL << k) - 1);
+                double d;
+                memcpy(&d, &t, sizeof(d));
+                // d and v are within a factor of 2, so the difference is exact
+                if (fabs(v - d) <= error) {
+                        return d;
+                }
+        }
+        return v;
+}
+
+static inline void
+truncate_mantissa(const double* in, ssize_t len, double* out, double error) {
+        if (!(error > 0) || !isfinite(error)) {
+                memcpy(out, in, len * sizeof(double));
+                return;
+        }
+        int error_exp = ilogb(error);
+        for (ssize_t i = 0; i < len; i++) {
+                out[i] = truncate_value(in[i], error, error_exp);
+        }
+}
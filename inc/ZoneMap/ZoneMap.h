@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Zone maps: the min, max, sum and count of a block, appended to the compressed block as a
+// trailer so a filter can skip the block without decoding it. The trailer does not depend on
+// the codec, the block in front of it is left as is and its decoder is handed the block without
+// the trailer. The statistics are those of the values given to the encoder: after a lossy codec
+// the decoded values may lie up to the error bound outside [min, max].
+//
+//      compressed block
+//      min, max, sum (double), count (uint32_t)
+//      ZONEMAP_MAGIC (uint32_t)
+
+#define ZONEMAP_MAGIC           0x314d5a5aU     // "ZZM1"
+#define ZONEMAP_SIZE            (3 * sizeof(double) + 2 * sizeof(uint32_t))
+#define ZONEMAP_LANES           4
+
+typedef struct {
+        double min;
+        double max;
+        double sum;
+        int64_t count;
+} ZoneMap;
+
+typedef ssize_t (*ZoneMapCompress) (double* in, ssize_t len, uint8_t** out, double error);
+typedef ssize_t (*ZoneMapDecompress) (uint8_t* in, ssize_t size, double* out, double error);
+
+/**
+ * Statistics of `len` values, NaNs are left out of min and max (but make the sum NaN).
+ * Every lane keeps its own accumulators, so the loop has no carried dependency across lanes.
+ */
+static inline void
+zonemap_scan(const double* in, ssize_t len, ZoneMap* stats) {
+        double min[ZONEMAP_LANES], max[ZONEMAP_LANES], sum[ZONEMAP_LANES];
+        for (int l = 0; l < ZONEMAP_LANES; l++) {
+                min[l] = __builtin_inf();
+                max[l] = -__builtin_inf();
+                sum[l] = 0;
+        }
+        ssize_t i = 0;
+        for (; i + ZONEMAP_LANES <= len; i += ZONEMAP_LANES) {
+                for (int l = 0; l < ZONEMAP_LANES; l++) {
+                        double v = in[i + l];
+                        min[l] = v < min[l] ? v : min[l];
+                        max[l] = v > max[l] ? v : max[l];
+                        sum[l] += v;
+                }
+        }
+        for (int l = 0; i < len; i++, l++) {
+                double v = in[i];
+                min[l] = v < min[l] ? v : min[l];
+                max[l] = v > max[l] ? v : max[l];
+                sum[l] += v;
+        }
+        stats->min = min[0];
+        stats->max = max[0];
+        stats->sum = sum[0];
+        for (int l = 1; l < ZONEMAP_LANES; l++) {
+                stats->min = min[l] < stats->min ? min[l] : stats->min;
+                stats->max = max[l] > stats->max ? max[l] : stats->max;
+                stats->sum += sum[l];
+        }
+        stats->count = len;
+}
+
+/**
+ * Appends the trailer to the malloc'd block `*out` of `size` bytes, returns the new size.
+ */
+static inline ssize_t
+zonemap_append(uint8_t** out, ssize_t size, const ZoneMap* stats) {
+        uint32_t tail[2] = {(uint32_t) stats->count, ZONEMAP_MAGIC};
+        *out = (uint8_t*) realloc(*out, size + ZONEMAP_SIZE);
+        // the block may end at any byte, the trailer is copied rather than cast
+        memcpy(*out + size, &stats->min, 3 * sizeof(double));
+        memcpy(*out + size + 3 * sizeof(double), tail, sizeof(tail));
+        return size + ZONEMAP_SIZE;
+}
+
+/**
+ * Reads the statistics of a block of `size` bytes written by zonemap_compress without decoding it.
+ * The magic only guards against a block of another writer, whose last bytes may match it:
+ * callers must know the block has a trailer. Returns 0 if the magic does not match.
+ */
+static inline int
+block_stats(const uint8_t* in, ssize_t size, ZoneMap* stats) {
+        uint32_t tail[2];
+        if (size < (ssize_t) ZONEMAP_SIZE) {
+                return 0;
+        }
+        memcpy(tail, in + size - sizeof(tail), sizeof(tail));
+        if (tail[1] != ZONEMAP_MAGIC) {
+                return 0;
+        }
+        memcpy(&stats->min, in + size - ZONEMAP_SIZE, 3 * sizeof(double));
+        stats->count = tail[0];
+        return 1;
+}
+
+/**
+ * Whether a block with these statistics may hold a value in [lo, hi], the bounds are widened
+ * by `error` for the blocks of lossy codecs. Blocks for which it returns 0 can be skipped.
+ */
+static inline int
+zonemap_overlaps(const ZoneMap* stats, double lo, double hi, double error) {
+        return stats->count > 0 && stats->max + error >= lo && stats->min - error <= hi;
+}
+
+/**
+ * Compresses `in` with `compress` and appends the zone map of the block.
+ */
+static inline ssize_t
+zonemap_compress(double* in, ssize_t len, uint8_t** out, double error, ZoneMapCompress compress) {
+        ZoneMap stats;
+        zonemap_scan(in, len, &stats);
+        ssize_t size = compress(in, len, out, error);
+        return zonemap_append(out, size, &stats);
+}
+
+/**
+ * Decompresses a block written by zonemap_compress, `decompress` is given the block without the trailer.
+ */
+static inline ssize_t
+zonemap_decompress(uint8_t* in, ssize_t size, double* out, double error, ZoneMapDecompress decompress) {
+        if (size < (ssize_t) ZONEMAP_SIZE) {
+                return -1;
+        }
+        return decompress(in, size - ZONEMAP_SIZE, out, error);
+}
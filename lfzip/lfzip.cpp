@@ -6,6 +6,7 @@
 #include <time.h>
 
 #include "bsc/libbsc.h"
+#include "Arena/Arena.h"
 #include "lfzip_predictor.cpp"
 #include "lfzip.h"
 
@@ -13,69 +14,183 @@
 #define MAX_BIN_IDX 32767
 
 int lfzip_init() {
-        return bsc_init(LIBBSC_FEATURE_FASTMODE);
+        return bsc_init(LIBBSC_FEATURE_FASTMODE | LIBBSC_FEATURE_MULTITHREADING);
 }
 
-ssize_t lfzip_compress(double *in, ssize_t in_size, uint8_t** out, double error) {
+// Quantize the prediction residuals into bin indices, the values that do not fit a bin are
+// marked with MIN_BIN_IDX-1 and stored verbatim in `overflow`. Returns the overflow count.
+static int lfzip_quantize(double *in, ssize_t in_size, double error, int16_t* bin_idx_array, double* overflow) {
         NLMS_predictor* predictor = new NLMS_predictor(32, 0.5);
-        std::vector<double> reconstruction(in_size);
-        uint8_t *tmp = (uint8_t*) malloc((sizeof(int16_t)+sizeof(double)) * in_size); 
-        int16_t* bin_idx_array = (int16_t*) tmp;
-        double* overflow = (double*) (tmp + sizeof(int16_t) * in_size);
-
-        uint32_t data_len = in_size;
         int of_size = 0;
         for (int i = 0; i < in_size; i++) {
                 double dataval = in[i];
-                double predval = predictor->predict(reconstruction, i);
-                // double predval = i == 0 ? 0 : reconstruction[i-1];
+                double predval = predictor->predict();
                 double diff = dataval - predval;
                 int64_t bin_idx = int64_t(std::round((diff / (2.0 * error))));
                 if (MIN_BIN_IDX <= bin_idx && bin_idx <= MAX_BIN_IDX) {
-                        reconstruction[i] = predval + (double)(error * bin_idx * 2.0);
-                        if (std::abs(reconstruction[i] - dataval) <= error) {
+                        double recon = predval + (double)(error * bin_idx * 2.0);
+                        if (std::abs(recon - dataval) <= error) {
                                 bin_idx_array[i] = (int16_t)bin_idx;
+                                predictor->update(recon);
                                 continue;
                         }
                 }
                 bin_idx_array[i] = (int16_t)(MIN_BIN_IDX - 1);
                 overflow[of_size++] = dataval;
-                reconstruction[i] = dataval;
+                predictor->update(dataval);
         }
         delete predictor;
+        return of_size;
+}
+
+// `bin_idx_array` may live in the last 2*len bytes of `out`: index i is always read
+// before out[i] is written, and out[i] never reaches past index i.
+static void lfzip_reconstruct(int16_t* bin_idx_array, double* overflow, uint32_t len, double error, double* out) {
+        int of_top = 0;
+        NLMS_predictor* predictor = new NLMS_predictor(32, 0.5);
+        for (int i = 0; i < len; i++) {
+                double predval = predictor->predict();
+                int64_t bin_idx = bin_idx_array[i];
+                double recon;
+                if (bin_idx == MIN_BIN_IDX-1) {
+                        recon = overflow[of_top++];
+                } else {
+                        recon = predval + (double)(error * bin_idx * 2.0);
+                }
+                out[i] = recon;
+                predictor->update(recon);
+        }
+        delete predictor;
+}
+
+// Destination for `len` decoded bin indices: the tail of `out` when possible.
+static inline int16_t* lfzip_idx_in_place(double* out, uint32_t len) {
+        return (int16_t*) ((uint8_t*) out + (sizeof(double) - sizeof(int16_t)) * len);
+}
+
+ssize_t lfzip_compress(double *in, ssize_t in_size, uint8_t** out, double error) {
+        ArenaScope scope;
+        uint8_t *tmp = (uint8_t*) scratch_alloc((sizeof(int16_t)+sizeof(double)) * in_size);
+        int16_t* bin_idx_array = (int16_t*) tmp;
+        double* overflow = (double*) (tmp + sizeof(int16_t) * in_size);
+
+        uint32_t data_len = in_size;
+        int of_size = lfzip_quantize(in, in_size, error, bin_idx_array, overflow);
 
         *out = (uint8_t*) malloc(4 + LIBBSC_HEADER_SIZE + sizeof(int16_t) * in_size + sizeof(double) * of_size);
         int res = bsc_compress(tmp, *out + 4, sizeof(int16_t) * in_size + sizeof(double) * (of_size), 
                 LIBBSC_DEFAULT_LZPHASHSIZE, LIBBSC_DEFAULT_LZPMINLEN, 
                 LIBBSC_DEFAULT_BLOCKSORTER, LIBBSC_DEFAULT_CODER, LIBBSC_FEATURE_FASTMODE);
         *(uint32_t*) *out = data_len;
-        free(tmp);
+        scratch_free(tmp);
         return res + 4;
 }
 
 ssize_t lfzip_decompress(uint8_t *in, ssize_t in_size, double* out, double error) {
+        ArenaScope scope;
         uint32_t len = *(uint32_t*) in;
 
-        int tmp_size = (sizeof(double) + sizeof(int16_t)) * len;
-        uint8_t* tmp = (uint8_t*) malloc(tmp_size);
+        int block_size, tmp_size;
+        bsc_block_info(in+4, in_size - 4, &block_size, &tmp_size, LIBBSC_FEATURE_FASTMODE);
+
+        // without overflow values the decoded block only holds the indices,
+        // which can be decoded straight into `out`.
+        uint8_t* tmp = tmp_size == sizeof(int16_t) * len
+                ? (uint8_t*) lfzip_idx_in_place(out, len)
+                : (uint8_t*) scratch_alloc(tmp_size);
         bsc_decompress(in+4, in_size - 4, tmp, tmp_size, LIBBSC_FEATURE_FASTMODE);
 
         int16_t* bin_idx_array = (int16_t*) tmp;
         double* overflow = (double*) (tmp + sizeof(int16_t) * len);
-        int of_top = 0;
-        NLMS_predictor* predictor = new NLMS_predictor(32, 0.5);
-        std::vector<double> reconstruction(len);
-        for (int i = 0; i < len; i++) {
-                double predval = predictor->predict(reconstruction, i);
-                int64_t bin_idx = bin_idx_array[i];
-                if (bin_idx == MIN_BIN_IDX-1) {
-                        reconstruction[i] = overflow[of_top++];
-                } else {
-                        reconstruction[i] = predval + (double)(error * bin_idx * 2.0);
+        lfzip_reconstruct(bin_idx_array, overflow, len, error, out);
+        if (tmp != (uint8_t*) lfzip_idx_in_place(out, len)) {
+                scratch_free(tmp);
+        }
+        return len;
+}
+
+//////////////////////////////// Parallel mode ////////////////////////////////
+
+// Block layout: data_len | idx_size | bsc(bin indices) [| bsc(overflow values)]
+// The two streams are coded independently so they can be (de)compressed concurrently,
+// and bsc is allowed to use its own threads once the input is large enough.
+
+static ssize_t lfzip_mt_min_len = LFZIP_MT_MIN_LEN;
+
+void lfzip_set_mt_min_len(ssize_t min_len) {
+        lfzip_mt_min_len = min_len;
+}
+
+static inline int lfzip_bsc_features(ssize_t len) {
+        return len >= lfzip_mt_min_len 
+                ? LIBBSC_FEATURE_FASTMODE | LIBBSC_FEATURE_MULTITHREADING
+                : LIBBSC_FEATURE_FASTMODE;
+}
+
+ssize_t lfzip_compress_mt(double *in, ssize_t in_size, uint8_t** out, double error) {
+        ArenaScope scope;
+        int16_t* bin_idx_array = (int16_t*) scratch_alloc(sizeof(int16_t) * in_size);
+        double* overflow = (double*) scratch_alloc(sizeof(double) * in_size);
+        int of_size = lfzip_quantize(in, in_size, error, bin_idx_array, overflow);
+
+        int idx_bytes = sizeof(int16_t) * in_size;
+        int of_bytes = sizeof(double) * of_size;
+        *out = (uint8_t*) malloc(8 + 2 * LIBBSC_HEADER_SIZE + idx_bytes + of_bytes);
+        uint8_t* idx_out = *out + 8;
+        // the overflow stream is compressed into a scratch buffer since the size of
+        // the index stream is not known beforehand.
+        uint8_t* of_out = (uint8_t*) scratch_alloc(LIBBSC_HEADER_SIZE + of_bytes);
+        int features = lfzip_bsc_features(in_size);
+        int idx_size = 0, of_csize = 0;
+
+        #pragma omp parallel sections num_threads(2) if (in_size >= lfzip_mt_min_len && of_size > 0)
+        {
+                #pragma omp section
+                idx_size = bsc_compress((uint8_t*) bin_idx_array, idx_out, idx_bytes,
+                        LIBBSC_DEFAULT_LZPHASHSIZE, LIBBSC_DEFAULT_LZPMINLEN,
+                        LIBBSC_DEFAULT_BLOCKSORTER, LIBBSC_DEFAULT_CODER, features);
+                #pragma omp section
+                if (of_size > 0) {
+                        of_csize = bsc_compress((uint8_t*) overflow, of_out, of_bytes,
+                                LIBBSC_DEFAULT_LZPHASHSIZE, LIBBSC_DEFAULT_LZPMINLEN,
+                                LIBBSC_DEFAULT_BLOCKSORTER, LIBBSC_DEFAULT_CODER, features);
                 }
         }
-        __builtin_memcpy(out, &reconstruction[0], sizeof(double) * len);
-        delete predictor;
-        free(tmp);
+        ((uint32_t*) *out)[0] = in_size;
+        ((uint32_t*) *out)[1] = idx_size;
+        __builtin_memcpy(idx_out + idx_size, of_out, of_csize);
+        scratch_free(of_out);
+        scratch_free(bin_idx_array);
+        scratch_free(overflow);
+        return 8 + idx_size + of_csize;
+}
+
+ssize_t lfzip_decompress_mt(uint8_t *in, ssize_t in_size, double* out, double error) {
+        ArenaScope scope;
+        uint32_t len = ((uint32_t*) in)[0];
+        int idx_size = ((uint32_t*) in)[1];
+        uint8_t* idx_in = in + 8;
+        uint8_t* of_in = idx_in + idx_size;
+        int of_csize = in_size - 8 - idx_size;
+
+        int of_bytes = 0, block_size;
+        if (of_csize > 0) {
+                bsc_block_info(of_in, of_csize, &block_size, &of_bytes, LIBBSC_FEATURE_FASTMODE);
+        }
+        int16_t* bin_idx_array = lfzip_idx_in_place(out, len);
+        double* overflow = (double*) scratch_alloc(of_bytes + sizeof(double));
+        int features = lfzip_bsc_features(len);
+
+        #pragma omp parallel sections num_threads(2) if (len >= lfzip_mt_min_len && of_csize > 0)
+        {
+                #pragma omp section
+                bsc_decompress(idx_in, idx_size, (uint8_t*) bin_idx_array, sizeof(int16_t) * len, features);
+                #pragma omp section
+                if (of_csize > 0) {
+                        bsc_decompress(of_in, of_csize, (uint8_t*) overflow, of_bytes, features);
+                }
+        }
+        lfzip_reconstruct(bin_idx_array, overflow, len, error, out);
+        scratch_free(overflow);
         return len;
-}
\ No newline at end of file
+}
@@ -11,6 +11,15 @@ int lfzip_init();
 ssize_t lfzip_compress(double *in, ssize_t in_size, uint8_t** out, double error);
 ssize_t lfzip_decompress(uint8_t *in, ssize_t in_size, double* out, double error);
 
+// Parallel mode: bin indices and overflow values are coded as two bsc streams that are
+// (de)compressed concurrently, and bsc multithreading is enabled, for inputs of at least
+// LFZIP_MT_MIN_LEN values (adjustable with lfzip_set_mt_min_len).
+#define LFZIP_MT_MIN_LEN (1 << 16)
+
+void lfzip_set_mt_min_len(ssize_t min_len);
+ssize_t lfzip_compress_mt(double *in, ssize_t in_size, uint8_t** out, double error);
+ssize_t lfzip_decompress_mt(uint8_t *in, ssize_t in_size, double* out, double error);
+
 #ifdef __cplusplus
 }
 #endif 
@@ -40,29 +40,46 @@ double NLMS_base::predict(const double *arr) {
   return dot_product(arr, &w[0], n);
 }
 
+// Keeps the last n+1 reconstructed samples in a ring that is stored twice back to back,
+// so the (n+1)-sample history window is always contiguous.
 class NLMS_predictor {
         NLMS_base *filter;
         uint32_t n;
+        uint32_t pos;
+        uint32_t count;
+        std::vector<double> hist;
 
 public:
         NLMS_predictor(const uint32_t n_, const double mu);
-        double predict(const std::vector<double> &recon_arr, const uint32_t idx);
+        double predict();
+        void update(const double recon_val);
         ~NLMS_predictor() { delete filter; }
 };
 
 NLMS_predictor::NLMS_predictor(const uint32_t n_, const double mu) {
         filter = new NLMS_base(n_, mu);
         n = n_;
+        pos = 0;
+        count = 0;
+        hist.resize(2 * (n + 1), 0.0);
 }
 
-double NLMS_predictor::predict(const std::vector<double> &recon_arr,
-                              const uint32_t idx) {
-        if (idx > n) {
-                filter->adapt(recon_arr[idx - 1], &recon_arr[idx - n - 1]);
-                return filter->predict(&recon_arr[idx - n]);
-        } else if (idx > 0 && idx <= n) {
-                return recon_arr[idx - 1];
+// Predict the sample following the ones passed to update() so far.
+double NLMS_predictor::predict() {
+        if (count > n) {
+                const double *win = &hist[pos];
+                filter->adapt(win[n], win);
+                return filter->predict(win + 1);
+        } else if (count > 0) {
+                return hist[pos + n];
         } else {
                 return 0.0;
         }
 }
+
+void NLMS_predictor::update(const double recon_val) {
+        hist[pos] = recon_val;
+        hist[pos + n + 1] = recon_val;
+        pos = pos == n ? 0 : pos + 1;
+        count++;
+}
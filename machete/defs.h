@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <unistd.h>
 #include "mach_errors.h"
+#include "Arena/Arena.h"
 
 union DOUBLE {
         double d;
@@ -63,14 +64,31 @@ ssize_t ovlq_decode(uint8_t* input, ssize_t size, int32_t* output);
 ssize_t hybrid_encode(int32_t* input, ssize_t len, uint8_t** output);
 ssize_t hybrid_decode(uint8_t* input, ssize_t size, int32_t* output);
 
-enum Encoder {huffman, huffmanC, ovlq, hybrid};
+////////////////////////////////////////// rANS //////////////////////////
 
-ssize_t lorenzo1_diff(double* input, ssize_t len, int32_t* output, double error, uint8_t** predictor_out, ssize_t* psize);
-ssize_t lorenzo1_correct(int32_t* input, ssize_t len, double* output, uint8_t* predictor_out, ssize_t psize);
+ssize_t rans_encode(int32_t* input, ssize_t len, uint8_t** output);
+ssize_t rans_decode(uint8_t* input, ssize_t size, int32_t* output);
+
+////////////////////////////////////////// Patched FOR //////////////////////////
+
+ssize_t pfor_encode(int32_t* input, ssize_t len, uint8_t** output);
+ssize_t pfor_decode(uint8_t* input, ssize_t size, int32_t* output);
+
+enum Encoder {huffman, huffmanC, ovlq, hybrid, rans, pfor};
+
+// Instantiated for double and float
+template<typename T>
+ssize_t lorenzo1_diff(T* input, ssize_t len, int32_t* output, double error, uint8_t** predictor_out, ssize_t* psize);
+template<typename T>
+ssize_t lorenzo1_correct(int32_t* input, ssize_t len, T* output, uint8_t* predictor_out, ssize_t psize);
 
 enum Predictor {lorenzo1};
 
 template<Predictor p, Encoder e>
 ssize_t machete_compress(double* input, ssize_t len, uint8_t** output, double error);
 template<Predictor p, Encoder e>
-ssize_t machete_decompress(uint8_t* input, ssize_t size, double* output);
\ No newline at end of file
+ssize_t machete_decompress(uint8_t* input, ssize_t size, double* output);
+template<Predictor p, Encoder e>
+ssize_t machete_compress_float(float* input, ssize_t len, uint8_t** output, double error);
+template<Predictor p, Encoder e>
+ssize_t machete_decompress_float(uint8_t* input, ssize_t size, float* output);
\ No newline at end of file
@@ -17,12 +17,11 @@ static bool less_on_lvl(HufTree *n0, HufTree* n1) {
 HufTree* huffman_build_tree(std::unordered_map<int32_t, size_t> &freq, HufTree* &nodes) {
         std::priority_queue<HufTree*, std::vector<HufTree*>, decltype(&great_on_cnt)> queue(great_on_cnt);
         
-        nodes = new HufTree[freq.size() * 2-1];
+        nodes = (HufTree*) scratch_alloc(sizeof(HufTree) * (freq.size() * 2-1));
 
         int cur_node = 0;
         for (auto ent : freq) {
-                nodes[cur_node].val = ent.first;
-                nodes[cur_node].cnt = ent.second;
+                nodes[cur_node] = {ent.first, (int32_t) ent.second, 0, NULL, NULL};
                 queue.push(&nodes[cur_node]);
                 cur_node++;
         }
@@ -164,21 +163,21 @@ ssize_t huffman_encode(int32_t* input, ssize_t len, uint8_t** output) {
         HufTree* nodes;
         HufTree* root = huffman_build_tree(freq, nodes);
         EncodeCodebook codebook;
-        int32_t* vals = new int32_t[freq.size()];
+        int32_t* vals = (int32_t*) scratch_alloc(sizeof(int32_t) * freq.size());
         ssize_t total_bitlen = huffman_build_encode_codebook(root, codebook, vals);
-        delete[] nodes;
+        scratch_free(nodes);
 
         ssize_t codebook_size = freq.size() * (sizeof(int32_t) + sizeof(int16_t));
         ssize_t code_size = (total_bitlen + 31) / 32 * 4;
         ssize_t osize = sizeof(HufHeader) + codebook_size + code_size;
-        *output = reinterpret_cast<uint8_t*>(malloc(osize));
+        *output = reinterpret_cast<uint8_t*>(scratch_alloc(osize));
         HufHeader* header = reinterpret_cast<HufHeader*>(*output);
         header->data_len = len;
         header->val_cnt = freq.size();
         header->code_size = code_size;
         huffman_store_codebook(codebook, vals, header->val_cnt, header->payload);
         huffman_store_code(codebook, input, len, header->payload + codebook_size, code_size);
-        delete[] vals;
+        scratch_free(vals);
 
         return osize;
 }
@@ -191,21 +190,21 @@ ssize_t huffman_encode_canonical(int32_t* input, ssize_t len, uint8_t** output)
         HufTree* nodes;
         HufTree* root = huffman_build_tree(freq, nodes);
         EncodeCodebook codebook;
-        int32_t* vals = new int32_t[freq.size()];
+        int32_t* vals = (int32_t*) scratch_alloc(sizeof(int32_t) * freq.size());
         ssize_t total_bitlen = huffman_build_canonical_encode_codebook(root, codebook, vals);
-        delete[] nodes;
+        scratch_free(nodes);
 
         ssize_t codebook_size = freq.size() * sizeof(int32_t) + (codebook[vals[codebook.size()-1]].bitlen - codebook[vals[0]].bitlen + 3) * sizeof(int16_t);
         ssize_t code_size = (total_bitlen + 31) / 32 * 4;
         ssize_t osize = sizeof(HufHeader) + codebook_size + code_size;
-        *output = reinterpret_cast<uint8_t*>(malloc(osize));
+        *output = reinterpret_cast<uint8_t*>(scratch_alloc(osize));
         HufHeader* header = reinterpret_cast<HufHeader*>(*output);
         header->data_len = len;
         header->val_cnt = freq.size();
         header->code_size = code_size;
         huffman_store_canonical_codebook(codebook, vals, header->val_cnt, header->payload);
         huffman_store_code(codebook, input, len, header->payload + codebook_size, code_size);
-        delete[] vals;
+        scratch_free(vals);
         return osize;
 }
 
@@ -214,7 +213,7 @@ ssize_t huffman_build_decode_codebook(int32_t* vals, int16_t* bitlens, uint32_t
         for (int i = 0; i < val_cnt; i++) {
                 max_bitlen = max_bitlen > bitlens[i] ? max_bitlen : bitlens[i];
         }
-        CodebookEntry* p = codebook = new CodebookEntry[1 << max_bitlen];
+        CodebookEntry* p = codebook = (CodebookEntry*) scratch_alloc(sizeof(CodebookEntry) << max_bitlen);
         for (int i = 0; i < val_cnt; i++) {
                 size_t times = 1UL << (max_bitlen - bitlens[i]);
                 for (int j = 0; j < times; j++) {
@@ -228,13 +227,16 @@ ssize_t huffman_build_decode_codebook_canonical(int32_t* vals, int16_t* bitlens,
         int16_t max_bitlen = bitlens[1];
         int bitlen = bitlens[0];
         int bitlen_cnt = 2;
-        CodebookEntry* p = codebook = new CodebookEntry[1 << max_bitlen];
+        // count down a copy, so the stored tree is left intact and the block can be decoded again
+        int remaining = bitlens[bitlen_cnt];
+        CodebookEntry* p = codebook = (CodebookEntry*) scratch_alloc(sizeof(CodebookEntry) << max_bitlen);
         for (int i = 0; i < val_cnt; i++) {
-                while (bitlens[bitlen_cnt] == 0) {
+                while (remaining == 0) {
                         bitlen_cnt++;
                         bitlen++;
+                        remaining = bitlens[bitlen_cnt];
                 }
-                bitlens[bitlen_cnt]--;
+                remaining--;
                 size_t times = 1UL << (max_bitlen - bitlen);
                 for (int j = 0; j < times; j++) {
                         *p++ = {vals[i], bitlen};
@@ -268,7 +270,7 @@ ssize_t huffman_decode(uint8_t* input, ssize_t size, int32_t* output) {
         ssize_t index_bitlen = huffman_build_decode_codebook(vals, bitlens, header->val_cnt, codebook);
         ssize_t codebook_size = header->val_cnt * (sizeof(int32_t) + sizeof(int16_t));
         huffman_decode_data(header->payload + codebook_size, header->code_size, codebook, index_bitlen, output, header->data_len);
-        delete[] codebook;
+        scratch_free(codebook);
         return header->data_len;
 }
 
@@ -280,6 +282,6 @@ ssize_t huffman_decode_canonical(uint8_t* input, ssize_t size, int32_t* output)
         ssize_t index_bitlen = huffman_build_decode_codebook_canonical(vals, bitlens, header->val_cnt, codebook);
         ssize_t codebook_size = header->val_cnt * sizeof(int32_t) + (bitlens[1] - bitlens[0] + 3) * sizeof(int16_t);
         huffman_decode_data(header->payload + codebook_size, header->code_size, codebook, index_bitlen, output, header->data_len);
-        delete[] codebook;
+        scratch_free(codebook);
         return header->data_len;
 }
\ No newline at end of file
@@ -38,7 +38,7 @@ ssize_t hybrid_data_partition(int32_t* input, ssize_t len, std::vector<int32_t>
         HufTree* nodes;
         HufTree* root = huffman_build_tree(freq, nodes);
         ssize_t total_bitlen = huffman_build_canonical_encode_codebook(root, codebook, &low_redundancy_data[0]);
-        delete[] nodes;
+        scratch_free(nodes);
         return total_bitlen;
 }
 
@@ -68,7 +68,7 @@ ssize_t hybrid_encode(int32_t* input, ssize_t len, uint8_t** output) {
         // fill header
         ssize_t huffman_tree_st_size = (max_code_bitlen - min_code_bitlen + 3) * sizeof(int16_t);
         ssize_t osize = sizeof(HybridHeader) + huffman_tree_st_size + ovlq_size + huffman_code_size;
-        *output = reinterpret_cast<uint8_t*>(malloc(osize));
+        *output = reinterpret_cast<uint8_t*>(scratch_alloc(osize));
         HybridHeader* header = reinterpret_cast<HybridHeader*>(*output);
         header->len = len;
         header->rare_cnt = rare_cnt;
@@ -95,7 +95,7 @@ ssize_t hybrid_encode(int32_t* input, ssize_t len, uint8_t** output) {
         // store ovlq result
         uint8_t* _ovlq_out = header->payload + huffman_tree_st_size;
         __builtin_memcpy(_ovlq_out, ovlq_out, ovlq_size);
-        free(ovlq_out);
+        scratch_free(ovlq_out);
 
         // store huffman_code
         uint8_t* huffman_out = _ovlq_out + ovlq_size;
@@ -109,13 +109,13 @@ ssize_t hybrid_decode(uint8_t* input, ssize_t size, int32_t* output) {
         uint8_t *ovlq_out = header->payload + (huffman_tree_st[1] - huffman_tree_st[0] + 3) * sizeof(int16_t);
         uint8_t *huffman_out = ovlq_out + header->ovlq_size;
         
-        int32_t *low_redundancy_data = new int32_t[header->val_cnt + header->rare_cnt];
+        int32_t *low_redundancy_data = (int32_t*) scratch_alloc(sizeof(int32_t) * (header->val_cnt + header->rare_cnt));
         ovlq_decode(ovlq_out, header->ovlq_size, low_redundancy_data);
         
         DecodeCodebook codebook;
         ssize_t index_bitlen = huffman_build_decode_codebook_canonical(low_redundancy_data, huffman_tree_st, header->val_cnt, codebook);
         huffman_decode_data(huffman_out, header->huffman_code_size, codebook, index_bitlen, output, header->len);
-        delete[] codebook;
+        scratch_free(codebook);
 
         if (header->rare_cnt) {
                 int32_t *rare = low_redundancy_data + header->val_cnt;
@@ -125,6 +125,6 @@ ssize_t hybrid_decode(uint8_t* input, ssize_t size, int32_t* output) {
                         }
                 }
         }
-        delete[] low_redundancy_data;
+        scratch_free(low_redundancy_data);
         return header->len;
 }
@@ -1,10 +1,16 @@
 #include <unistd.h>
 #include <stdint.h>
 
-enum Encoder {huffman, huffmanC, ovlq, hybrid};
+enum Encoder {huffman, huffmanC, ovlq, hybrid, rans, pfor};
 enum Predictor {lorenzo1};
 
 template<Predictor p, Encoder e>
 ssize_t machete_compress(double* input, ssize_t len, uint8_t** output, double error);
 template<Predictor p, Encoder e>
 ssize_t machete_decompress(uint8_t* input, ssize_t size, double* output);
+
+// Single-precision input; the prediction is carried in float, like the decoder's output.
+template<Predictor p, Encoder e>
+ssize_t machete_compress_float(float* input, ssize_t len, uint8_t** output, double error);
+template<Predictor p, Encoder e>
+ssize_t machete_decompress_float(uint8_t* input, ssize_t size, float* output);
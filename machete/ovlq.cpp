@@ -21,7 +21,8 @@ static inline int data_bitlen(int32_t data) {
 }
 
 int32_t ovlq_search_optimal_mapping(int32_t *data_min_bitlen, ssize_t len, ssize_t &total_bitlen) {
-        int32_t *buffer = new int32_t[99] {0};
+        // at most 33 distinct bit lengths, the tables live on the stack
+        int32_t buffer[99] = {0};
         int32_t *range_cnt = buffer;
         int32_t *range_sum = range_cnt + 33;
         int32_t *range = range_sum + 33;
@@ -49,11 +50,10 @@ int32_t ovlq_search_optimal_mapping(int32_t *data_min_bitlen, ssize_t len, ssize
         if (range_top == 1) {
                 total_bitlen = range[0] * len;
                 int32_t mapping = 1 << (range[0] - 1);
-                delete[] buffer;
                 return mapping;
         } 
 
-        int32_t* buffer2 = new int32_t[range_top*3];
+        int32_t buffer2[33 * 3];
         int32_t* C = buffer2;
         int32_t* A = C + range_top;
         int32_t* M = A + range_top;
@@ -78,8 +78,6 @@ int32_t ovlq_search_optimal_mapping(int32_t *data_min_bitlen, ssize_t len, ssize
 
         int32_t optimal_mapping = M[range_top-1];
         total_bitlen = C[range_top-1];
-        delete[] buffer;
-        delete[] buffer2;
         return optimal_mapping;
 }
 
@@ -95,7 +93,7 @@ OVLQ_EncodeTable ovlq_build_encode_table_with_mapping(int32_t mapping) {
         int level = __builtin_popcount(mapping);
         assert(level > 0);
         if (level > 1) {
-                OVLQ_EncodeTable table = new OVLQ_EncodeTableEntry[33];
+                OVLQ_EncodeTable table = (OVLQ_EncodeTable) scratch_alloc(sizeof(OVLQ_EncodeTableEntry) * 33);
                 int t = 1;
                 int flag = 0;
                 for (int i = 1; i < level; i++) {
@@ -117,7 +115,7 @@ OVLQ_EncodeTable ovlq_build_encode_table_with_mapping(int32_t mapping) {
 }
 
 ssize_t ovlq_encode(int32_t* input, ssize_t len, uint8_t** output) {
-        int32_t *data_min_bitlen = new int32_t[len];
+        int32_t *data_min_bitlen = (int32_t*) scratch_alloc(sizeof(int32_t) * len);
         for (int i = 0; i < len; i++) {
                 data_min_bitlen[i] = data_bitlen(input[i]);
         }
@@ -126,7 +124,7 @@ ssize_t ovlq_encode(int32_t* input, ssize_t len, uint8_t** output) {
         OVLQ_EncodeTable table = ovlq_build_encode_table_with_mapping(optimal_mapping);
 
         ssize_t osize = sizeof(OVLQ_Header) + ALIGN_UP(DIV_UP(optimal_total_bitlen,3),2);
-        *output = reinterpret_cast<uint8_t*>(malloc(osize));
+        *output = reinterpret_cast<uint8_t*>(scratch_alloc(osize));
         OVLQ_Header *header = reinterpret_cast<OVLQ_Header*>(*output);
         header->len = len;
         header->mapping = optimal_mapping;
@@ -144,10 +142,10 @@ ssize_t ovlq_encode(int32_t* input, ssize_t len, uint8_t** output) {
                         write(&writer, entry->flag, entry->flen);
                         write(&writer, input[i], entry->dlen);
                 }
-                delete[] table;
+                scratch_free(table);
         }
         flush(&writer);
-        delete[] data_min_bitlen;
+        scratch_free(data_min_bitlen);
         return osize;
 }
 
@@ -162,7 +160,7 @@ OVLQ_DecodeTable ovlq_build_decode_table_with_mapping(int64_t mapping, ssize_t &
         int32_t level = __builtin_popcountll(mapping);
         int32_t min_len = __builtin_ctzll(mapping);
         int ent_cnt = 1 << (level - 1);
-        OVLQ_DecodeTable table = new OVLQ_DecodeTableEntry[ent_cnt];
+        OVLQ_DecodeTable table = (OVLQ_DecodeTable) scratch_alloc(sizeof(OVLQ_DecodeTableEntry) * ent_cnt);
         uint32_t mask = 1 << (level - 2);
         OVLQ_DecodeTableEntry entry = {1, min_len};
         for (int i = 0; i < ent_cnt; i++) {
@@ -205,7 +203,7 @@ ssize_t ovlq_decode(uint8_t* input, ssize_t size, int32_t* output) {
                         forward(&reader, entry.dlen);
                         output[i] = data << (32 - entry.dlen) >> (32 - entry.dlen);
                 }
-                delete[] table;
+                scratch_free(table);
                 return header->len;
         }
 }
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "defs.h"
+#include <array>
+#include <utility>
+#include "BitStream/BitWriter.h"
+#include "BitStream/BitReader.h"
+#include "BitPack/BitPack.h"
+
+// Patched frame of reference: the zigzagged residuals are bit-packed in blocks of PFOR_BLOCK
+// values, each block with the width that minimizes its size. The values wider than that are
+// exceptions, their low bits stay in the block and their high bits are patched back from
+// the exception section at the end. The blocks are packed lane-interleaved (inc/BitPack/BitPack.h),
+// a row of PFOR_LANES values is one SSE2 register, and the kernels are unrolled for every width.
+//
+//      PForHeader
+//      PForBlock descriptors
+//      the packed blocks, width * PFOR_LANES words each
+//      the exception positions (uint8_t) of all blocks, padded to 4 bytes, then their high bits
+
+#define PFOR_BLOCK              128
+#define PFOR_LANES              4
+#define PFOR_ROWS               (PFOR_BLOCK / PFOR_LANES)
+#define PFOR_EXCEPTION_BITS     8       // position of an exception, its high bits come on top
+
+struct PForHeader {
+        int32_t len;
+        int32_t exception_size;         // bytes of the exception section
+        uint8_t payload[0];
+};
+
+struct PForBlock {
+        uint8_t width;
+        uint8_t exceptions;
+        uint8_t high_width;             // bits of the exceptions above `width`
+        uint8_t pad;
+};
+
+typedef void (*PForKernel)(const uint32_t* in, uint32_t* out);
+
+static inline uint32_t zigzag(int32_t v) {
+        return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+        return static_cast<int32_t>((v >> 1) ^ -(v & 1));
+}
+
+static inline int bit_width(uint32_t v) {
+        return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/**
+ * Packs PFOR_BLOCK values of `width` bits (the ones above are dropped) into width * PFOR_LANES words.
+ */
+template<int width>
+static void pfor_pack(const uint32_t* in, uint32_t* out) {
+        bitpack<uint32_t, PFOR_LANES>(in, out, width, PFOR_ROWS);
+}
+
+template<int width>
+static void pfor_unpack(const uint32_t* in, uint32_t* out) {
+        bitunpack<uint32_t, PFOR_LANES>(in, out, width, PFOR_ROWS);
+}
+
+template<int... width>
+static constexpr std::array<PForKernel, sizeof...(width)> pfor_packers_of(std::integer_sequence<int, width...>) {
+        return {{pfor_pack<width>...}};
+}
+
+template<int... width>
+static constexpr std::array<PForKernel, sizeof...(width)> pfor_unpackers_of(std::integer_sequence<int, width...>) {
+        return {{pfor_unpack<width>...}};
+}
+
+// the kernels of widths 0 to 32
+static constexpr auto pfor_packers = pfor_packers_of(std::make_integer_sequence<int, 33>());
+static constexpr auto pfor_unpackers = pfor_unpackers_of(std::make_integer_sequence<int, 33>());
+
+/**
+ * Picks the width of a block from the histogram of the widths of its values,
+ * on ties the larger width, which leaves fewer exceptions to patch.
+ */
+static PForBlock pfor_choose(const uint32_t* in) {
+        int32_t cnt[33] = {0};
+        for (int i = 0; i < PFOR_BLOCK; i++) {
+                cnt[bit_width(in[i])]++;
+        }
+        int max_width = 32;
+        while (max_width > 0 && cnt[max_width] == 0) {
+                max_width--;
+        }
+        PForBlock best = {static_cast<uint8_t>(max_width), 0, 0, 0};
+        int64_t best_cost = PFOR_BLOCK * max_width;
+        int exceptions = 0;
+        for (int w = max_width - 1; w >= 0; w--) {
+                exceptions += cnt[w + 1];
+                int64_t cost = PFOR_BLOCK * w + exceptions * (PFOR_EXCEPTION_BITS + max_width - w);
+                if (exceptions < 256 && cost < best_cost) {
+                        best_cost = cost;
+                        best = {static_cast<uint8_t>(w), static_cast<uint8_t>(exceptions), static_cast<uint8_t>(max_width - w), 0};
+                }
+        }
+        return best;
+}
+
+ssize_t pfor_encode(int32_t* input, ssize_t len, uint8_t** output) {
+        ssize_t blocks = (len + PFOR_BLOCK - 1) / PFOR_BLOCK;
+        uint32_t* zz = reinterpret_cast<uint32_t*>(scratch_alloc(sizeof(uint32_t) * blocks * PFOR_BLOCK));
+        for (ssize_t i = 0; i < len; i++) {
+                zz[i] = zigzag(input[i]);
+        }
+        for (ssize_t i = len; i < blocks * PFOR_BLOCK; i++) {
+                zz[i] = 0;
+        }
+
+        PForBlock* desc = reinterpret_cast<PForBlock*>(scratch_alloc(sizeof(PForBlock) * blocks));
+        ssize_t words = 0, exceptions = 0, high_bits = 0;
+        for (ssize_t b = 0; b < blocks; b++) {
+                desc[b] = pfor_choose(zz + b * PFOR_BLOCK);
+                words += desc[b].width * PFOR_LANES;
+                exceptions += desc[b].exceptions;
+                high_bits += desc[b].exceptions * desc[b].high_width;
+        }
+        ssize_t position_size = (exceptions + 3) / 4 * 4;
+        ssize_t high_words = (high_bits + 31) / 32;
+        ssize_t exception_size = position_size + high_words * sizeof(uint32_t);
+        ssize_t osize = sizeof(PForHeader) + blocks * sizeof(PForBlock) + words * sizeof(uint32_t) + exception_size;
+        // initBitWriter wants room for one word even without exceptions
+        *output = reinterpret_cast<uint8_t*>(scratch_alloc(osize + sizeof(uint32_t)));
+        PForHeader* header = reinterpret_cast<PForHeader*>(*output);
+        header->len = len;
+        header->exception_size = exception_size;
+        __builtin_memcpy(header->payload, desc, blocks * sizeof(PForBlock));
+
+        uint32_t* packed = reinterpret_cast<uint32_t*>(header->payload + blocks * sizeof(PForBlock));
+        uint8_t* positions = reinterpret_cast<uint8_t*>(packed + words);
+        __builtin_memset(positions, 0, position_size);
+        BitWriter writer;
+        initBitWriter(&writer, reinterpret_cast<uint32_t*>(positions + position_size), high_words + 1);
+        for (ssize_t b = 0; b < blocks; b++) {
+                const uint32_t* in = zz + b * PFOR_BLOCK;
+                pfor_packers[desc[b].width](in, packed);
+                packed += desc[b].width * PFOR_LANES;
+                for (int i = 0; i < PFOR_BLOCK && desc[b].exceptions; i++) {
+                        if (bit_width(in[i]) > desc[b].width) {
+                                *positions++ = i;
+                                write(&writer, in[i] >> desc[b].width, desc[b].high_width);
+                        }
+                }
+        }
+        flush(&writer);
+        scratch_free(desc);
+        scratch_free(zz);
+        return osize;
+}
+
+ssize_t pfor_decode(uint8_t* input, ssize_t size, int32_t* output) {
+        PForHeader* header = reinterpret_cast<PForHeader*>(input);
+        ssize_t len = header->len;
+        ssize_t blocks = (len + PFOR_BLOCK - 1) / PFOR_BLOCK;
+        PForBlock* desc = reinterpret_cast<PForBlock*>(header->payload);
+        const uint32_t* packed = reinterpret_cast<const uint32_t*>(desc + blocks);
+        const uint8_t* positions = input + size - header->exception_size;
+        ssize_t exceptions = 0;
+        for (ssize_t b = 0; b < blocks; b++) {
+                exceptions += desc[b].exceptions;
+        }
+        BitReader reader;
+        // the reader loads its first word at once, a stream without high bits gets a dummy one
+        uint32_t none = 0;
+        const uint8_t* high = positions + (exceptions + 3) / 4 * 4;
+        ssize_t high_words = (input + size - high) / sizeof(uint32_t);
+        initBitReader(&reader, high_words ? (uint32_t*) high : &none, high_words ? high_words : 1);
+
+        uint32_t tail[PFOR_BLOCK];
+        for (ssize_t b = 0; b < blocks; b++) {
+                // the last block may be partial, the caller's buffer only has room for `len` values
+                uint32_t* out = (b + 1) * PFOR_BLOCK <= len ? reinterpret_cast<uint32_t*>(output + b * PFOR_BLOCK) : tail;
+                pfor_unpackers[desc[b].width](packed, out);
+                packed += desc[b].width * PFOR_LANES;
+                for (int k = 0; k < desc[b].exceptions; k++) {
+                        out[*positions++] |= peek(&reader, desc[b].high_width) << desc[b].width;
+                        forward(&reader, desc[b].high_width);
+                }
+                int32_t* o = output + b * PFOR_BLOCK;
+                int n = len - b * PFOR_BLOCK < PFOR_BLOCK ? len - b * PFOR_BLOCK : PFOR_BLOCK;
+                for (int i = 0; i < n; i++) {
+                        o[i] = unzigzag(out[i]);
+                }
+        }
+        return len;
+}
@@ -1,15 +1,17 @@
 #include "defs.h"
 #include <stdlib.h>
-#include <vector>
+#include <cmath>
 
+template<typename T>
 struct LorenzoConfig {
         double error;
-        double first;
-        double outiers[0];
+        T first;
+        T outiers[0];
 };
 
-static inline int32_t diff(const double &data, const double &predicted, const DOUBLE &e, const double &e2, const double &max_diff) {
-        DOUBLE d = {.d = data - predicted};
+template<typename T>
+static inline int32_t diff(const T &data, const T &predicted, const DOUBLE &e, const double &e2, const double &max_diff) {
+        DOUBLE d = {.d = (double) data - predicted};
         DOUBLE d_abs = {.i = d.i & ~DOUBLE_SIGN_BIT};
         if (UNLIKELY(d_abs.d > max_diff)) {
                 return INT32_MIN;
@@ -19,42 +21,52 @@ static inline int32_t diff(const double &data, const double &predicted, const DO
         return static_cast<int32_t>(d.d / e2);
 }
 
-ssize_t lorenzo1_diff(double* input, ssize_t len, int32_t* output, double error, uint8_t** predictor_out, ssize_t* psize) {
-        std::vector<double> outier;
+template<typename T>
+ssize_t lorenzo1_diff(T* input, ssize_t len, int32_t* output, double error, uint8_t** predictor_out, ssize_t* psize) {
+        // outliers are written straight into the config, sized for the worst case
+        *predictor_out = reinterpret_cast<uint8_t*>(scratch_alloc(sizeof(LorenzoConfig<T>) + len * sizeof(T)));
+        LorenzoConfig<T>* config = reinterpret_cast<LorenzoConfig<T>*>(*predictor_out);
+        T* outier = config->outiers;
         DOUBLE e = {.d= error * 0.999};
         double e2 = e.d * 2;
         double max_diff = e2 * INT32_MAX;
-        double predicted = input[0];
+        T predicted = input[0];
         for (int i = 1; i < len; i++) {
                 *output = diff(input[i], predicted, e, e2, max_diff);
                 if (UNLIKELY(*output == INT32_MIN)) {
-                        outier.push_back(input[i]);
+                        *outier++ = input[i];
                         predicted = input[i];
                 } else {
                         predicted += *output * e2;
+                        // rounding the prediction to single precision can cost more than the
+                        // 0.1% error margin, such values are kept as outliers.
+                        if (sizeof(T) < sizeof(double) && UNLIKELY(std::abs((double) input[i] - predicted) > error)) {
+                                *output = INT32_MIN;
+                                *outier++ = input[i];
+                                predicted = input[i];
+                        }
                 }
                 output++;
         }
-        *psize = sizeof(LorenzoConfig) + outier.size() * sizeof(double);
-        *predictor_out = reinterpret_cast<uint8_t*>(malloc(*psize));
-        LorenzoConfig* config = reinterpret_cast<LorenzoConfig*>(*predictor_out);
+        *psize = reinterpret_cast<uint8_t*>(outier) - *predictor_out;
         config->error = error;
         config->first = input[0];
-        __builtin_memcpy(config->outiers, &outier[0], outier.size() * sizeof(double));
         return len - 1;
 }
 
-ssize_t lorenzo1_correct(int32_t* input, ssize_t len, double* output, uint8_t* predictor_out, ssize_t psize) {
-        LorenzoConfig* config = reinterpret_cast<LorenzoConfig*>(predictor_out);
+template<typename T>
+ssize_t lorenzo1_correct(int32_t* input, ssize_t len, T* output, uint8_t* predictor_out, ssize_t psize) {
+        LorenzoConfig<T>* config = reinterpret_cast<LorenzoConfig<T>*>(predictor_out);
         double e2 = config->error * 0.999 * 2;
         
         output[0] = config->first; 
-        if (psize == sizeof(LorenzoConfig)) {
+        // for float the outliers start inside the struct padding, so sizeof can't tell if there are any
+        if (psize == reinterpret_cast<uint8_t*>(config->outiers) - predictor_out) {
                 for (int i = 0; i < len; i++) {
                         output[i+1] = output[i] + e2 * input[i];
                 }
         } else {
-                double* outier = config->outiers;
+                T* outier = config->outiers;
                 for (int i = 0; i < len; i++) {
                         if (UNLIKELY(input[i] == INT32_MIN)) {
                                 output[i+1] = *outier++;
@@ -66,6 +78,7 @@ ssize_t lorenzo1_correct(int32_t* input, ssize_t len, double* output, uint8_t* p
         return len + 1;
 }
 
-
-
-
+template ssize_t lorenzo1_diff<double>(double*, ssize_t, int32_t*, double, uint8_t**, ssize_t*);
+template ssize_t lorenzo1_diff<float>(float*, ssize_t, int32_t*, double, uint8_t**, ssize_t*);
+template ssize_t lorenzo1_correct<double>(int32_t*, ssize_t, double*, uint8_t*, ssize_t);
+template ssize_t lorenzo1_correct<float>(int32_t*, ssize_t, float*, uint8_t*, ssize_t);
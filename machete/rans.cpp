@@ -0,0 +1,235 @@
+#include "defs.h"
+#include <vector>
+#include <algorithm>
+
+// Interleaved rANS: RANS_LANES 32-bit states take the symbols in turn and share one stream of
+// 16-bit renormalization words, so the decoder has RANS_LANES independent dependency chains.
+// Frequencies are normalized to 2^scale_bits, about the block length (between
+// RANS_MIN_SCALE_BITS and RANS_MAX_SCALE_BITS): a finer scale would not describe the
+// counts any better, and a short block would spend more on the decoding table than on
+// its symbols. The symbols of the table are the
+// RANS_MAX_SYMBOLS most frequent values seen more than once, the others are coded as one
+// escape symbol (the last one of the table) and stored through ovlq, like the rare values
+// of the hybrid encoder. The header keeps the counts of the symbols rather than their
+// frequencies, the decoder normalizes them again. As the symbols are sorted by count, each
+// count is stored as its difference with the next one (the last one minus 2), mostly 0,
+// in an ovlq block of its own so the wide symbols don't widen them.
+
+#define RANS_LANES              4
+#define RANS_MIN_SCALE_BITS     9               // room for RANS_MAX_SYMBOLS and the escape symbol
+#define RANS_MAX_SCALE_BITS     12
+#define RANS_L                  (1u << 16)      // lower bound of a normalized state
+#define RANS_MAX_SYMBOLS        255
+
+struct RansHeader {
+        int32_t len;
+        int32_t sym_cnt;                // symbols of the table, the escape one excluded
+        int32_t escape_cnt;             // values coded as the escape symbol
+        int32_t count_size;             // ovlq block of the counts, none without symbols
+        int32_t ovlq_size;              // ovlq block of the symbols and the escaped values
+        uint32_t state[RANS_LANES];     // final encoder states, where decoding starts
+        uint8_t payload[0];             // the two ovlq blocks, then the words
+};
+
+// Decoding table, one entry per slot of [0, 2^scale_bits)
+struct RansSlot {
+        int32_t val;
+        uint16_t freq;
+        uint16_t start;
+};
+
+static inline int rans_scale_bits(ssize_t len) {
+        int bits = len > 1 ? 64 - __builtin_clzl(len - 1) : 0;
+        return std::min(std::max(bits, RANS_MIN_SCALE_BITS), RANS_MAX_SCALE_BITS);
+}
+
+/**
+ * Scales `cnt` (summing to `total`) to frequencies summing to `scale`, none below 1.
+ * The rounding error goes to the most frequent symbols, whose code lengths it changes the least.
+ */
+static void rans_normalize(const int32_t* cnt, int n, ssize_t total, int32_t scale, int32_t* freq) {
+        int32_t sum = 0;
+        int largest = 0;
+        for (int i = 0; i < n; i++) {
+                freq[i] = std::max<int32_t>(1, (int64_t) cnt[i] * scale / total);
+                sum += freq[i];
+                largest = freq[i] > freq[largest] ? i : largest;
+        }
+        if (freq[largest] + scale - sum > 0) {
+                freq[largest] += scale - sum;
+                return;
+        }
+        // too many symbols were raised to 1, take the excess back from every symbol above 1
+        for (int i = 0; sum > scale; i = (i + 1) % n) {
+                if (freq[i] > 1) {
+                        freq[i]--;
+                        sum--;
+                }
+        }
+}
+
+ssize_t rans_encode(int32_t* input, ssize_t len, uint8_t** output) {
+        std::unordered_map<int32_t, size_t> freq_map;
+        for (int i = 0; i < len; i++) {
+                freq_map[input[i]]++;
+        }
+        std::vector<std::pair<int32_t, size_t>> syms(freq_map.begin(), freq_map.end());
+        std::sort(syms.begin(), syms.end(), [](const std::pair<int32_t, size_t>& a, const std::pair<int32_t, size_t>& b) {
+                return a.second > b.second || (a.second == b.second && a.first < b.first);
+        });
+        int sym_cnt = 0;
+        while (sym_cnt < (int) syms.size() && sym_cnt < RANS_MAX_SYMBOLS && syms[sym_cnt].second > 1) {
+                sym_cnt++;
+        }
+        ssize_t escape_cnt = 0;
+        for (int s = sym_cnt; s < (int) syms.size(); s++) {
+                escape_cnt += syms[s].second;
+        }
+        int table_cnt = sym_cnt + (escape_cnt > 0);
+
+        // symbol of every value, sym_cnt for the escaped ones
+        std::unordered_map<int32_t, int32_t> index;
+        for (int s = 0; s < (int) syms.size(); s++) {
+                index[syms[s].first] = s < sym_cnt ? s : sym_cnt;
+        }
+        std::vector<int32_t> cnt(table_cnt), freq(table_cnt), start(table_cnt);
+        for (int s = 0; s < sym_cnt; s++) {
+                cnt[s] = syms[s].second;
+        }
+        if (escape_cnt) {
+                cnt[sym_cnt] = escape_cnt;
+        }
+        int scale_bits = rans_scale_bits(len);
+        rans_normalize(cnt.data(), table_cnt, len, 1 << scale_bits, freq.data());
+        for (int s = 1; s < table_cnt; s++) {
+                start[s] = start[s - 1] + freq[s - 1];
+        }
+
+        std::vector<int32_t> counts(sym_cnt), side(sym_cnt + escape_cnt);
+        for (int s = 0; s < sym_cnt; s++) {
+                counts[s] = cnt[s] - (s + 1 < sym_cnt ? cnt[s + 1] : 2);
+                side[s] = syms[s].first;
+        }
+        int32_t* symbol = reinterpret_cast<int32_t*>(scratch_alloc(sizeof(int32_t) * len));
+        int32_t* escape = side.data() + sym_cnt;
+        for (int i = 0; i < len; i++) {
+                symbol[i] = index[input[i]];
+                if (symbol[i] == sym_cnt) {
+                        *escape++ = input[i];
+                }
+        }
+        uint8_t* count_out = NULL;
+        ssize_t count_size = sym_cnt ? ovlq_encode(counts.data(), sym_cnt, &count_out) : 0;
+        uint8_t* ovlq_out;
+        ssize_t ovlq_size = ovlq_encode(side.data(), side.size(), &ovlq_out);
+
+        // the words are pushed from the end of the buffer, as the decoder reads them in reverse,
+        // at most one per symbol
+        uint16_t* words = reinterpret_cast<uint16_t*>(scratch_alloc(sizeof(uint16_t) * len));
+        uint16_t* top = words + len;
+        uint32_t state[RANS_LANES];
+        for (int l = 0; l < RANS_LANES; l++) {
+                state[l] = RANS_L;
+        }
+        for (ssize_t i = len - 1; i >= 0; i--) {
+                uint32_t& x = state[i % RANS_LANES];
+                uint32_t f = freq[symbol[i]];
+                if (x >= ((uint64_t) (RANS_L >> scale_bits) << 16) * f) {
+                        *--top = static_cast<uint16_t>(x);
+                        x >>= 16;
+                }
+                x = ((x / f) << scale_bits) + (x % f) + start[symbol[i]];
+        }
+        ssize_t word_cnt = words + len - top;
+
+        ssize_t words_size = (word_cnt * sizeof(uint16_t) + 3) / 4 * 4;
+        ssize_t osize = sizeof(RansHeader) + count_size + ovlq_size + words_size;
+        *output = reinterpret_cast<uint8_t*>(scratch_alloc(osize));
+        RansHeader* header = reinterpret_cast<RansHeader*>(*output);
+        header->len = len;
+        header->sym_cnt = sym_cnt;
+        header->escape_cnt = escape_cnt;
+        header->count_size = count_size;
+        header->ovlq_size = ovlq_size;
+        for (int l = 0; l < RANS_LANES; l++) {
+                header->state[l] = state[l];
+        }
+        if (count_out) {
+                __builtin_memcpy(header->payload, count_out, count_size);
+                scratch_free(count_out);
+        }
+        __builtin_memcpy(header->payload + count_size, ovlq_out, ovlq_size);
+        __builtin_memcpy(header->payload + count_size + ovlq_size, top, word_cnt * sizeof(uint16_t));
+        scratch_free(ovlq_out);
+        scratch_free(words);
+        scratch_free(symbol);
+        return osize;
+}
+
+/**
+ * Decodes the next symbol of state `x`, the escape symbol has the last slots,
+ * so it is told apart without a lookup.
+ */
+static inline int32_t rans_decode_symbol(uint32_t& x, const RansSlot* table, int scale_bits, int32_t escape_start,
+                const uint16_t*& words, int32_t*& escape) {
+        uint32_t slot = x & ((1 << scale_bits) - 1);
+        RansSlot e = table[slot];
+        int32_t val = UNLIKELY((int32_t) slot >= escape_start) ? *escape++ : e.val;
+        x = e.freq * (x >> scale_bits) + slot - e.start;
+        if (x < RANS_L) {
+                x = (x << 16) | *words++;
+        }
+        return val;
+}
+
+ssize_t rans_decode(uint8_t* input, ssize_t size, int32_t* output) {
+        RansHeader* header = reinterpret_cast<RansHeader*>(input);
+        ssize_t len = header->len;
+        int sym_cnt = header->sym_cnt;
+        int table_cnt = sym_cnt + (header->escape_cnt > 0);
+        int32_t cnt[RANS_MAX_SYMBOLS + 1], freq[RANS_MAX_SYMBOLS + 1];
+        if (sym_cnt) {
+                ovlq_decode(header->payload, header->count_size, cnt);
+        }
+        for (int s = sym_cnt - 2; s >= 0; s--) {
+                cnt[s] += cnt[s + 1];
+        }
+        for (int s = 0; s < sym_cnt; s++) {
+                cnt[s] += 2;
+        }
+        cnt[sym_cnt] = header->escape_cnt;
+        int scale_bits = rans_scale_bits(len);
+        rans_normalize(cnt, table_cnt, len, 1 << scale_bits, freq);
+        uint8_t* ovlq_out = header->payload + header->count_size;
+        int32_t* side = reinterpret_cast<int32_t*>(scratch_alloc(sizeof(int32_t) * (sym_cnt + header->escape_cnt)));
+        ovlq_decode(ovlq_out, header->ovlq_size, side);
+        int32_t* escape = side + sym_cnt;
+
+        RansSlot* table = reinterpret_cast<RansSlot*>(scratch_alloc(sizeof(RansSlot) << scale_bits));
+        int32_t escape_start = 1 << scale_bits;
+        for (int s = 0, slot = 0; s < table_cnt; s++) {
+                escape_start = s == sym_cnt ? slot : escape_start;
+                for (int k = 0; k < freq[s]; k++) {
+                        table[slot + k] = {s < sym_cnt ? side[s] : 0, static_cast<uint16_t>(freq[s]), static_cast<uint16_t>(slot)};
+                }
+                slot += freq[s];
+        }
+
+        const uint16_t* words = reinterpret_cast<const uint16_t*>(ovlq_out + header->ovlq_size);
+        uint32_t state[RANS_LANES];
+        for (int l = 0; l < RANS_LANES; l++) {
+                state[l] = header->state[l];
+        }
+        ssize_t i = 0;
+        for (; i + RANS_LANES <= len; i += RANS_LANES) {
+                for (int l = 0; l < RANS_LANES; l++) {
+                        output[i + l] = rans_decode_symbol(state[l], table, scale_bits, escape_start, words, escape);
+                }
+        }
+        for (; i < len; i++) {
+                output[i] = rans_decode_symbol(state[i % RANS_LANES], table, scale_bits, escape_start, words, escape);
+        }
+        scratch_free(table);
+        scratch_free(side);
+        return len;
+}
@@ -1,5 +1,6 @@
 #include "defs.h"
 #include <stdio.h>
+#include <cstdlib>
 
 #define DLEN 1000
 
@@ -49,6 +50,8 @@ void test_encoder(Encoder e) {
                 case huffmanC: printf("Testing huffman(canonical)"); break;
                 case ovlq: printf("Testing ovlq"); break;
                 case hybrid: printf("Testing hybrid encoder"); break;
+                case rans: printf("Testing rANS"); break;
+                case pfor: printf("Testing PFor"); break;
                 default: printf("unknown encoder"); return;
         }
         printf("----------\n");
@@ -57,6 +60,8 @@ void test_encoder(Encoder e) {
                 case huffmanC: compressed_size = huffman_encode_canonical(data, DLEN, &output); break;
                 case ovlq: compressed_size = ovlq_encode(data, DLEN, &output); break;
                 case hybrid: compressed_size = hybrid_encode(data, DLEN, &output); break;
+                case rans: compressed_size = rans_encode(data, DLEN, &output); break;
+                case pfor: compressed_size = pfor_encode(data, DLEN, &output); break;
         }
         printf("compression ratio = %lf\n", static_cast<double>(sizeof(data)) / compressed_size);
         switch (e) {
@@ -64,6 +69,8 @@ void test_encoder(Encoder e) {
                 case huffmanC: decompressed_len = huffman_decode_canonical(output, compressed_size, data2); break;
                 case ovlq: decompressed_len = ovlq_decode(output, compressed_size, data2); break;
                 case hybrid: decompressed_len = hybrid_decode(output, compressed_size, data2); break;
+                case rans: decompressed_len = rans_decode(output, compressed_size, data2); break;
+                case pfor: decompressed_len = pfor_decode(output, compressed_size, data2); break;
         }
         
         if (check_data_int(decompressed_len)) {
@@ -72,6 +79,8 @@ void test_encoder(Encoder e) {
                         case huffmanC: printf("huffman(canonical) test passed\n"); break;
                         case ovlq: printf("ovlq test passed\n"); break;
                         case hybrid: printf("hybrid test passed\n"); break;
+                        case rans: printf("rANS test passed\n"); break;
+                        case pfor: printf("PFor test passed\n"); break;
                 }
         }
         free(output);
@@ -118,6 +127,30 @@ int main() {
         }
         test_encoder(hybrid);
 
+        __builtin_memset(data, 0, sizeof(data));
+        test_encoder(rans);
+        for (int i = 0; i < 1000; i++) {
+                data[i] = rand() % 20;
+        }
+        test_encoder(rans);
+        // mostly values seen once, which go through the escape symbol
+        for (int i = 0; i < 1000; i++) {
+                data[i] = i % 3 ? rand() - RAND_MAX / 2 : 0;
+        }
+        test_encoder(rans);
+
+        __builtin_memset(data, 0, sizeof(data));
+        test_encoder(pfor);
+        for (int i = 0; i < 1000; i++) {
+                data[i] = rand() % 20;
+        }
+        test_encoder(pfor);
+        // small values with a few wide ones, which are patched in as exceptions
+        for (int i = 0; i < 1000; i++) {
+                data[i] = i % 50 ? rand() % 8 - 4 : rand() - RAND_MAX / 2;
+        }
+        test_encoder(pfor);
+
         FILE* fp;
         __builtin_memset(data3, 0, sizeof(data3));
         test_machete<lorenzo1, huffman>(1E-5);
@@ -140,5 +173,19 @@ int main() {
         fclose(fp);
         test_machete<lorenzo1, hybrid>(1E-6);
 
+        __builtin_memset(data3, 0, sizeof(data3));
+        test_machete<lorenzo1, rans>(1E-5);
+        fp = fopen("tmp0.data", "r");
+        fread(data3, sizeof(double), DLEN, fp);
+        fclose(fp);
+        test_machete<lorenzo1, rans>(1E-6);
+
+        __builtin_memset(data3, 0, sizeof(data3));
+        test_machete<lorenzo1, pfor>(1E-5);
+        fp = fopen("tmp0.data", "r");
+        fread(data3, sizeof(double), DLEN, fp);
+        fclose(fp);
+        test_machete<lorenzo1, pfor>(1E-6);
+
         return 0;
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cstdint>
+
+#include "gorilla/gorilla.h"
+#include "chimp/chimp.h"
+#include "machete/machete.h"
+#include "batch.h"
+#include "Arena/Arena.h"
+#include "Pyramid/Pyramid.h"
+
+// Round-trip tests of the modules outside machete/ (which has its own test).
+
+#define DLEN 1000
+
+#define BATCH_COLS 5
+#define BATCH_ROWS 999
+
+int64_t ts[DLEN];
+int64_t ts2[DLEN];
+double values[DLEN];
+double values2[DLEN];
+float floats[DLEN];
+float floats2[DLEN];
+double columns[BATCH_COLS * BATCH_ROWS];
+double columns2[BATCH_COLS * BATCH_ROWS];
+
+bool check_timestamps(ssize_t len, ssize_t expected) {
+        if (len != expected) {
+                printf("Length mismatch: %zd vs %zd!\n", len, expected);
+                return false;
+        }
+        for (ssize_t i = 0; i < len; i++) {
+                if (ts[i] != ts2[i]) {
+                        printf("Timestamp mismatch: %zd: %ld vs %ld!\n", i, ts[i], ts2[i]);
+                        return false;
+                }
+        }
+        return true;
+}
+
+bool test_timestamp(const char* name, ssize_t len) {
+        printf("-----------Testing timestamps (%s)----------\n", name);
+        uint8_t* output;
+        ssize_t compressed_size = timestamp_encode(ts, len, &output);
+        ssize_t decompressed_len = timestamp_decode(output, compressed_size, ts2);
+        bool ok = check_timestamps(decompressed_len, len);
+        if (ok) {
+                printf("timestamp test passed\n");
+        }
+        free(output);
+
+        printf("-----------Testing series (%s)----------\n", name);
+        compressed_size = series_encode(ts, values, len, &output);
+        decompressed_len = series_decode(output, compressed_size, ts2, values2);
+        bool series_ok = check_timestamps(decompressed_len, len);
+        for (ssize_t i = 0; series_ok && i < len; i++) {
+                if (memcmp(&values[i], &values2[i], sizeof(double))) {
+                        printf("Value mismatch: %zd: %.16lf vs %.16lf!\n", i, values[i], values2[i]);
+                        series_ok = false;
+                }
+        }
+        if (series_ok) {
+                printf("series test passed\n");
+        }
+        free(output);
+        return ok && series_ok;
+}
+
+bool test_batch(int cols, ssize_t rows, bool cross) {
+        printf("-----------Testing batch (%d x %zd%s)----------\n", cols, rows, cross ? ", cross" : "");
+        double error = 1e-3;
+        uint8_t* output;
+        ssize_t compressed_size = batch_machete_compress(columns, rows, cols, &output, error, cross);
+        ssize_t decompressed_len = batch_machete_decompress(output, compressed_size, columns2, error);
+        bool ok = true;
+        if (decompressed_len != cols * rows) {
+                printf("Length mismatch: %zd vs %zd!\n", decompressed_len, cols * rows);
+                ok = false;
+        }
+        for (ssize_t i = 0; ok && i < cols * rows; i++) {
+                if (fabs(columns[i] - columns2[i]) > error) {
+                        printf("Value mismatch: %zd: %.16lf vs %.16lf!\n", i, columns[i], columns2[i]);
+                        ok = false;
+                }
+        }
+        if (ok) {
+                printf("batch test passed, ratio %.2lf\n", (double) cols * rows * sizeof(double) / compressed_size);
+        }
+        free(output);
+        return ok;
+}
+
+bool test_chimp_lossy(const char* name, double error) {
+        printf("-----------Testing chimp lossy (%s)----------\n", name);
+        uint8_t* output;
+        ssize_t lossless_size = chimp_encode(values, DLEN, &output, 0);
+        free(output);
+        ssize_t compressed_size = chimp_encode_lossy(values, DLEN, &output, error);
+        ssize_t decompressed_len = chimp_decode(output, compressed_size, values2, error);
+        bool ok = true;
+        if (decompressed_len != DLEN) {
+                printf("Length mismatch: %zd vs %d!\n", decompressed_len, DLEN);
+                ok = false;
+        }
+        for (ssize_t i = 0; ok && i < DLEN; i++) {
+                if (fabs(values[i] - values2[i]) > error) {
+                        printf("Value mismatch: %zd: %.16lf vs %.16lf!\n", i, values[i], values2[i]);
+                        ok = false;
+                }
+        }
+        if (ok && compressed_size > lossless_size) {
+                printf("Size mismatch: lossy %zd vs lossless %zd bytes!\n", compressed_size, lossless_size);
+                ok = false;
+        }
+        if (ok) {
+                printf("chimp lossy test passed, ratio %.2lf vs %.2lf lossless\n",
+                        (double) DLEN * sizeof(double) / compressed_size, (double) DLEN * sizeof(double) / lossless_size);
+        }
+        free(output);
+        return ok;
+}
+
+bool test_machete_float(const char* name, double error) {
+        printf("-----------Testing machete float (%s)----------\n", name);
+        uint8_t* output;
+        ssize_t compressed_size = machete_compress_float<lorenzo1, hybrid>(floats, DLEN, &output, error);
+        ssize_t decompressed_len = machete_decompress_float<lorenzo1, hybrid>(output, compressed_size, floats2);
+        bool ok = true;
+        if (decompressed_len != DLEN) {
+                printf("Length mismatch: %zd vs %d!\n", decompressed_len, DLEN);
+                ok = false;
+        }
+        for (ssize_t i = 0; ok && i < DLEN; i++) {
+                if (fabs((double) floats[i] - floats2[i]) > error) {
+                        printf("Value mismatch: %zd: %.8f vs %.8f!\n", i, floats[i], floats2[i]);
+                        ok = false;
+                }
+        }
+        if (ok) {
+                printf("machete float test passed\n");
+        }
+        free(output);
+        return ok;
+}
+
+bool test_pyramid() {
+        printf("-----------Testing pyramid trailers----------\n");
+        PyramidBucket buckets[DLEN];
+        ssize_t span;
+        uint8_t* block = (uint8_t*) malloc(8);
+        memset(block, 0, 8);
+        ssize_t size = pyramid_append(&block, 8, values, DLEN, 64);
+        bool ok = pyramid_read(block, size, DLEN, buckets, &span) == (DLEN + 63) / 64 && span == 64;
+        if (!ok) {
+                printf("Pyramid mismatch: the finest level was not read back!\n");
+        }
+        // len, span | fanout << 16: a zero span, a fanout of 1, more buckets than the block holds
+        uint32_t corrupt[][2] = {{DLEN, 0 | PYRAMID_FANOUT << 16}, {DLEN, 64 | 1 << 16}, {1000000, 64 | PYRAMID_FANOUT << 16}};
+        for (auto& tail : corrupt) {
+                memcpy(block + size - PYRAMID_TRAILER_SIZE, tail, sizeof(tail));
+                if (ok && (pyramid_size(block, size) != -1 || pyramid_read(block, size, DLEN, buckets, &span) != -1)) {
+                        printf("Pyramid mismatch: corrupt trailer %u, %x was accepted!\n", tail[0], tail[1]);
+                        ok = false;
+                }
+        }
+        if (ok) {
+                printf("pyramid test passed\n");
+        }
+        free(block);
+        return ok;
+}
+
+bool test_arena() {
+        printf("-----------Testing arena rewinds----------\n");
+        Arena arena;
+        arena_init(&arena);
+        // a long-lived allocation below the marks, then blocks that outgrow the first chunk
+        arena_alloc(&arena, 1000);
+        size_t sizes[] = {40000, 100000, 8000, 300000};
+        size_t warm = 0;
+        bool ok = true;
+        for (int block = 0; ok && block < 100; block++) {
+                ArenaMark mark = arena_mark(&arena);
+                for (size_t bytes : sizes) {
+                        uint8_t* p = (uint8_t*) arena_alloc(&arena, bytes);
+                        memset(p, block, bytes);
+                }
+                arena_rewind(&arena, mark);
+                if (arena.head == NULL || arena.head->used != mark.used) {
+                        printf("Rewind mismatch at block %d!\n", block);
+                        ok = false;
+                }
+                // the chunks of the first block are enough for all the others
+                if (block == 0) {
+                        warm = arena.chunks;
+                } else if (arena.chunks > warm + 1) {
+                        printf("Chunk mismatch at block %d: %zu chunks vs %zu after the first block!\n",
+                                block, arena.chunks, warm);
+                        ok = false;
+                }
+        }
+        size_t steady = arena.chunks;
+        for (int block = 0; ok && block < 100; block++) {
+                ArenaMark mark = arena_mark(&arena);
+                for (size_t bytes : sizes) {
+                        arena_alloc(&arena, bytes);
+                }
+                arena_rewind(&arena, mark);
+        }
+        if (ok && arena.chunks != steady) {
+                printf("Chunk mismatch: %zu chunks malloc'd over 100 steady blocks!\n", arena.chunks - steady);
+                ok = false;
+        }
+        if (ok) {
+                printf("arena test passed, %zu chunks\n", arena.chunks);
+        }
+        arena_destroy(&arena);
+        return ok;
+}
+
+int main() {
+        bool ok = true;
+        // regular: a fixed period, every delta-of-delta is 0
+        for (int i = 0; i < DLEN; i++) {
+                ts[i] = 1700000000000L + i * 1000;
+                values[i] = i * 0.25;
+        }
+        ok &= test_timestamp("regular", DLEN);
+        // irregular: jitter in every bucket, a gap and a step back
+        for (int i = 1; i < DLEN; i++) {
+                int64_t jitter = i % 7 == 0 ? rand() % 4096 : i % 5 == 0 ? rand() % 512 : rand() % 64;
+                ts[i] = ts[i-1] + 1000 + jitter;
+                values[i] = (rand() % 100000) / 100.0;
+        }
+        ts[500] += 1L << 40;
+        ts[501] = ts[500] - 3;
+        ok &= test_timestamp("irregular", DLEN);
+        ok &= test_timestamp("single", 1);
+        ok &= test_timestamp("empty", 0);
+        // chimp lossy: a smooth series with noise below the error bound, and prices in cents
+        for (int i = 0; i < DLEN; i++) {
+                values[i] = sin(i * 0.01) * 10 + (rand() % 1000) / 1e5;
+        }
+        ok &= test_chimp_lossy("smooth", 1e-3);
+        values[0] = 100;
+        for (int i = 1; i < DLEN; i++) {
+                values[i] = round((values[i-1] + (rand() % 201 - 100) / 100.0) * 100) / 100;
+        }
+        ok &= test_chimp_lossy("price", 1e-3);
+        // machete float: a step too large for the quantized residuals is the block's only outlier
+        for (int i = 0; i < DLEN; i++) {
+                floats[i] = sinf(i * 0.01f) + (i >= DLEN / 2 ? 1e7f : 0);
+        }
+        ok &= test_machete_float("one outlier", 1e-3);
+        ok &= test_pyramid();
+        ok &= test_arena();
+        // batch: correlated channels, rows chosen so that the column blocks end at odd bytes
+        for (int c = 0; c < BATCH_COLS; c++) {
+                for (int i = 0; i < BATCH_ROWS; i++) {
+                        columns[c * BATCH_ROWS + i] = sin(i * 0.01) * (c + 1) + (rand() % 1000) / 1e5;
+                }
+        }
+        int batch_cols[] = {1, 2, 3, 5};
+        ssize_t batch_rows[] = {1, 7, 333, BATCH_ROWS};
+        for (int c : batch_cols) {
+                for (ssize_t r : batch_rows) {
+                        ok &= test_batch(c, r, false);
+                        ok &= test_batch(c, r, true);
+                }
+        }
+        if (!ok) {
+                printf("Some unit tests failed!\n");
+        }
+        return ok ? 0 : 1;
+}
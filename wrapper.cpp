@@ -2,66 +2,329 @@
 #include <stdlib.h>
 #include <zlib.h>
 #include <zstd.h>
+#include <zdict.h>
+#include <vector>
+
+#include "wrapper.h"
+#include "bsc/libbsc.h"
+#include "Shuffle/Shuffle.h"
 // If you are a ordinary linux user like me without sudo permission,
 // you can install zstd and zlib by conda: then add the include path to your VSCode C/C++ configuration.
 // Ctrl+Shift+P to open: C/C++: Edit Configurations (UI) to add `/mnt/driver_g/users/usr6/.conda/envs/test/include` in the `Include path` field.
 
+// Setting up a zstd/zlib context costs more than compressing a 500-2000 point slice,
+// so every thread keeps its own contexts alive and only resets them between blocks.
+
+static int zstd_level = 3;
+static int zstd_workers = 0;
+static ssize_t zstd_workers_min_len = 1 << 20;
+static int zlib_level = Z_DEFAULT_COMPRESSION;
+
+void zstd_set_level(int level) {
+        zstd_level = level;
+}
+
+/**
+ * Use `nb_workers` zstd worker threads for blocks of at least `min_len` values.
+ * Requires libzstd to be built with multithreading support, ignored otherwise.
+ */
+void zstd_set_workers(int nb_workers, ssize_t min_len) {
+        zstd_workers = nb_workers;
+        zstd_workers_min_len = min_len;
+}
+
+void zlib_set_level(int level) {
+        zlib_level = level;
+}
+
+struct ZstdContext {
+        ZSTD_CCtx* cctx;
+        ZSTD_DCtx* dctx;
+        int level;
+        int workers;
+
+        ZstdContext() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()), level(-1), workers(0) {}
+        ~ZstdContext() {
+                ZSTD_freeCCtx(cctx);
+                ZSTD_freeDCtx(dctx);
+        }
+};
+
+static thread_local ZstdContext zstd_ctx;
+
+static ssize_t zstd_compress_bytes(const void* in, size_t size, uint8_t* out, size_t capacity) {
+        int workers = size >= zstd_workers_min_len * sizeof(double) ? zstd_workers : 0;
+        if (zstd_ctx.level != zstd_level) {
+                ZSTD_CCtx_setParameter(zstd_ctx.cctx, ZSTD_c_compressionLevel, zstd_level);
+                zstd_ctx.level = zstd_level;
+        }
+        if (zstd_ctx.workers != workers) {
+                ZSTD_CCtx_setParameter(zstd_ctx.cctx, ZSTD_c_nbWorkers, workers);
+                zstd_ctx.workers = workers;
+        }
+        // ZSTD_compress2 starts a new frame on the persistent context, keeping its tables.
+        return ZSTD_compress2(zstd_ctx.cctx, out, capacity, in, size);
+}
 
 ssize_t zstd_compress(double* in, ssize_t len, uint8_t** out, double error) {
         ssize_t max_size = ZSTD_compressBound(len * sizeof(double));
         *out = (uint8_t*) malloc(max_size);
-        return ZSTD_compress(*out, max_size, in, len * sizeof(double), 3);
+        return zstd_compress_bytes(in, len * sizeof(double), *out, max_size);
 }
 
 ssize_t zstd_decompress(uint8_t* in, ssize_t len, double* out, double error) {
         ssize_t out_size = ZSTD_getFrameContentSize(in, len);
-        return ZSTD_decompress(out, out_size, in, len)/sizeof(double);
+        return ZSTD_decompressDCtx(zstd_ctx.dctx, out, out_size, in, len)/sizeof(double);
 }
 
-ssize_t zlib_compress(double* in, ssize_t len, uint8_t** out, double error) {
-        ssize_t out_size = compressBound(len * sizeof(double));
-        *out = (uint8_t*) malloc(out_size);
+/////////////////////////////////// Dictionary ///////////////////////////////////
+
+// A 500-2000 point slice is too short for zstd to learn its context, so a dictionary
+// trained over sample blocks of the dataset is prepared once and shared by all threads.
+// Frames record the dictionary ID, decompression looks the dictionary up by that ID.
+
+struct ZstdDictionary {
+        unsigned id;
+        ZSTD_CDict* cdict;
+        ZSTD_DDict* ddict;
+};
 
-        z_stream stream = {
-                (Bytef*)in, (uint32_t) (len*sizeof(double)), 0,
-                *out, (uint32_t) out_size, 0,
-                NULL, NULL,
-                NULL, NULL, NULL,
-                Z_BINARY, 0, 0
+static std::vector<ZstdDictionary> zstd_dicts;
+static const ZSTD_CDict* zstd_cdict = NULL;
+
+unsigned zstd_dict_train(double* samples, size_t* block_lens, unsigned nb_blocks, size_t dict_size) {
+        std::vector<size_t> sizes(nb_blocks);
+        for (unsigned i = 0; i < nb_blocks; i++) {
+                sizes[i] = block_lens[i] * sizeof(double);
+        }
+        std::vector<uint8_t> dict(dict_size);
+        size_t size = ZDICT_trainFromBuffer(dict.data(), dict_size, samples, sizes.data(), nb_blocks);
+        if (ZDICT_isError(size)) {
+                zstd_cdict = NULL;
+                return 0;
+        }
+        unsigned id = ZDICT_getDictID(dict.data(), size);
+        for (auto &d : zstd_dicts) {
+                if (d.id == id) {
+                        zstd_cdict = d.cdict;
+                        return id;
+                }
+        }
+        ZstdDictionary d = {
+                id,
+                ZSTD_createCDict(dict.data(), size, zstd_level),
+                ZSTD_createDDict(dict.data(), size),
         };
+        zstd_dicts.push_back(d);
+        zstd_cdict = d.cdict;
+        return d.id;
+}
 
-        deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-        deflate(&stream, Z_FINISH);
-        out_size -= stream.avail_out;
-        deflateEnd(&stream);
-        return out_size;
+void zstd_dict_free() {
+        for (auto &d : zstd_dicts) {
+                ZSTD_freeCDict(d.cdict);
+                ZSTD_freeDDict(d.ddict);
+        }
+        zstd_dicts.clear();
+        zstd_cdict = NULL;
+}
+
+ssize_t zstd_dict_compress(double* in, ssize_t len, uint8_t** out, double error) {
+        if (zstd_cdict == NULL) {
+                return zstd_compress(in, len, out, error);
+        }
+        ssize_t max_size = ZSTD_compressBound(len * sizeof(double));
+        *out = (uint8_t*) malloc(max_size);
+        return ZSTD_compress_usingCDict(zstd_ctx.cctx, *out, max_size, in, len * sizeof(double), zstd_cdict);
+}
+
+ssize_t zstd_dict_decompress(uint8_t* in, ssize_t len, double* out, double error) {
+        unsigned id = ZSTD_getDictID_fromFrame(in, len);
+        if (id == 0) {
+                return zstd_decompress(in, len, out, error);
+        }
+        const ZSTD_DDict* ddict = NULL;
+        for (auto &d : zstd_dicts) {
+                if (d.id == id) {
+                        ddict = d.ddict;
+                        break;
+                }
+        }
+        if (__builtin_expect(ddict == NULL, 0)) {
+                return -1;
+        }
+        ssize_t out_size = ZSTD_getFrameContentSize(in, len);
+        return ZSTD_decompress_usingDDict(zstd_ctx.dctx, out, out_size, in, len, ddict)/sizeof(double);
+}
+
+struct ZlibContext {
+        z_stream deflater;
+        z_stream inflater;
+        int level;
+        bool deflater_ready;
+        bool inflater_ready;
+
+        ZlibContext() : level(Z_DEFAULT_COMPRESSION), deflater_ready(false), inflater_ready(false) {}
+        ~ZlibContext() {
+                if (deflater_ready) deflateEnd(&deflater);
+                if (inflater_ready) inflateEnd(&inflater);
+        }
+};
+
+static thread_local ZlibContext zlib_ctx;
+
+static ssize_t zlib_compress_bytes(const void* in, size_t size, uint8_t* out, size_t capacity) {
+        z_stream* stream = &zlib_ctx.deflater;
+        if (!zlib_ctx.deflater_ready) {
+                *stream = {
+                        NULL, 0, 0,
+                        NULL, 0, 0,
+                        NULL, NULL,
+                        NULL, NULL, NULL,
+                        Z_BINARY, 0, 0
+                };
+                deflateInit(stream, zlib_level);
+                zlib_ctx.level = zlib_level;
+                zlib_ctx.deflater_ready = true;
+        } else {
+                deflateReset(stream);
+                if (zlib_ctx.level != zlib_level) {
+                        deflateParams(stream, zlib_level, Z_DEFAULT_STRATEGY);
+                        zlib_ctx.level = zlib_level;
+                }
+        }
+        stream->next_in = (Bytef*) in;
+        stream->avail_in = (uint32_t) size;
+        stream->next_out = out;
+        stream->avail_out = (uint32_t) capacity;
+
+        deflate(stream, Z_FINISH);
+        return capacity - stream->avail_out;
+}
+
+static z_stream* zlib_inflater() {
+        z_stream* stream = &zlib_ctx.inflater;
+        if (!zlib_ctx.inflater_ready) {
+                *stream = {
+                        NULL, 0, 0,
+                        NULL, 0, 0,
+                        NULL, NULL,
+                        NULL, NULL, NULL,
+                        Z_BINARY,
+                        0, 0
+                };
+                inflateInit(stream);
+                zlib_ctx.inflater_ready = true;
+        } else {
+                inflateReset(stream);
+        }
+        return stream;
+}
+
+ssize_t zlib_compress(double* in, ssize_t len, uint8_t** out, double error) {
+        ssize_t out_size = compressBound(len * sizeof(double));
+        *out = (uint8_t*) malloc(out_size);
+        return zlib_compress_bytes(in, len * sizeof(double), *out, out_size);
 }
 
 ssize_t zlib_decompress(uint8_t* in, ssize_t len, double* out, double error) {
         ssize_t out_size = len * 4;
-        z_stream stream = {
-                (Bytef*) in, (uint32_t) len, 0,
-                (Bytef*) out, (uint32_t) out_size, 0,
-                NULL, NULL,
-                NULL, NULL, NULL,
-                Z_BINARY,
-                0, 0
-        };
+        z_stream* stream = zlib_inflater();
+        stream->next_in = (Bytef*) in;
+        stream->avail_in = (uint32_t) len;
+        stream->next_out = (Bytef*) out;
+        stream->avail_out = (uint32_t) out_size;
 
-        inflateInit(&stream);
-        int ret = inflate(&stream, Z_NO_FLUSH);
+        int ret = inflate(stream, Z_NO_FLUSH);
         while (ret != Z_STREAM_END) {
-                if (__builtin_expect(stream.avail_out == 0, 0)) {
+                if (__builtin_expect(stream->avail_out == 0, 0)) {
                         size_t cur_len = out_size;
                         out_size *= 2;
-                        stream.next_out = ((Bytef*)out) + cur_len;
-                        stream.avail_out = cur_len;
+                        stream->next_out = ((Bytef*)out) + cur_len;
+                        stream->avail_out = cur_len;
                 }
-                ret = inflate(&stream, Z_NO_FLUSH);
+                ret = inflate(stream, Z_NO_FLUSH);
         }
-        out_size -= stream.avail_out;
-        inflateEnd(&stream);
+        out_size -= stream->avail_out;
 
         return out_size/sizeof(double);
 }
 
+/////////////////////////////////// Shuffle ///////////////////////////////////
+
+typedef struct __attribute__((__packed__)) {
+        uint32_t data_len;
+        uint8_t codec;
+        uint8_t mode;
+        uint8_t payload[0];
+} ShuffleHeader;
+
+static thread_local std::vector<uint8_t> shuffle_buffer, shuffle_tmp;
+
+ssize_t shuffle_compress(double* in, ssize_t len, uint8_t** out, int codec, int mode) {
+        size_t size = len * sizeof(double);
+        shuffle_buffer.resize(size);
+        shuffle_tmp.resize(size);
+        shuffle_encode(in, len, shuffle_buffer.data(), shuffle_tmp.data(), mode);
+
+        size_t capacity;
+        switch (codec) {
+                case GENERAL_ZSTD: capacity = ZSTD_compressBound(size); break;
+                case GENERAL_ZLIB: capacity = compressBound(size); break;
+                default: capacity = size + LIBBSC_HEADER_SIZE; break;
+        }
+        *out = (uint8_t*) malloc(sizeof(ShuffleHeader) + capacity);
+        ShuffleHeader* header = (ShuffleHeader*) *out;
+        header->data_len = len;
+        header->codec = codec;
+        header->mode = mode;
+
+        ssize_t csize;
+        switch (codec) {
+                case GENERAL_ZSTD:
+                        csize = zstd_compress_bytes(shuffle_buffer.data(), size, header->payload, capacity);
+                        break;
+                case GENERAL_ZLIB:
+                        csize = zlib_compress_bytes(shuffle_buffer.data(), size, header->payload, capacity);
+                        break;
+                default:
+                        csize = bsc_compress(shuffle_buffer.data(), header->payload, size,
+                                LIBBSC_DEFAULT_LZPHASHSIZE, LIBBSC_DEFAULT_LZPMINLEN,
+                                LIBBSC_DEFAULT_BLOCKSORTER, LIBBSC_DEFAULT_CODER, LIBBSC_FEATURE_FASTMODE);
+                        break;
+        }
+        return sizeof(ShuffleHeader) + csize;
+}
+
+ssize_t shuffle_decompress(uint8_t* in, ssize_t len, double* out, double error) {
+        ShuffleHeader* header = (ShuffleHeader*) in;
+        size_t size = header->data_len * sizeof(double);
+        ssize_t csize = len - sizeof(ShuffleHeader);
+        shuffle_buffer.resize(size);
+        shuffle_tmp.resize(size);
+
+        z_stream* stream;
+        bool ok;
+        switch (header->codec) {
+                case GENERAL_ZSTD:
+                        ok = ZSTD_decompressDCtx(zstd_ctx.dctx, shuffle_buffer.data(), size, header->payload, csize) == size;
+                        break;
+                case GENERAL_ZLIB:
+                        stream = zlib_inflater();
+                        stream->next_in = header->payload;
+                        stream->avail_in = (uint32_t) csize;
+                        stream->next_out = shuffle_buffer.data();
+                        stream->avail_out = (uint32_t) size;
+                        ok = inflate(stream, Z_FINISH) == Z_STREAM_END && stream->avail_out == 0;
+                        break;
+                default:
+                        ok = bsc_decompress(header->payload, csize, shuffle_buffer.data(), size, LIBBSC_FEATURE_FASTMODE) == LIBBSC_NO_ERROR;
+                        break;
+        }
+        // a truncated or corrupt payload must not be unshuffled into `out`
+        if (__builtin_expect(!ok, 0)) {
+                return -1;
+        }
+        shuffle_decode(shuffle_buffer.data(), header->data_len, out, shuffle_tmp.data(), header->mode);
+        return header->data_len;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <unistd.h>
+
+ssize_t zlib_compress   (double* in, ssize_t len, uint8_t** out, double error);
+ssize_t zlib_decompress (uint8_t* in, ssize_t len, double* out, double error);
+ssize_t zstd_compress   (double* in, ssize_t len, uint8_t** out, double error);
+ssize_t zstd_decompress (uint8_t* in, ssize_t len, double* out, double error);
+void zstd_set_level     (int level);
+void zstd_set_workers   (int nb_workers, ssize_t min_len);
+void zlib_set_level     (int level);
+
+/**
+ * Train a zstd dictionary of at most `dict_size` bytes over `nb_blocks` sample blocks stored
+ * back to back in `samples`, block i holding block_lens[i] values.
+ * The dictionary is used by subsequent zstd_dict_compress calls; older ones stay available
+ * for decompression. Returns the dictionary ID, or 0 if training failed (too few samples),
+ * in which case zstd_dict_compress falls back to plain zstd.
+ */
+unsigned zstd_dict_train        (double* samples, size_t* block_lens, unsigned nb_blocks, size_t dict_size);
+void zstd_dict_free             ();
+ssize_t zstd_dict_compress      (double* in, ssize_t len, uint8_t** out, double error);
+ssize_t zstd_dict_decompress    (uint8_t* in, ssize_t len, double* out, double error);
+
+// General-purpose codecs that can sit behind the shuffle stage (see inc/Shuffle/Shuffle.h).
+enum GeneralCodec {GENERAL_ZSTD, GENERAL_ZLIB, GENERAL_BSC};
+
+/**
+ * Shuffle the doubles according to `mode` (a ShuffleMode combination) and compress the
+ * result with `codec`. Both are recorded in the block, so one decompressor serves all.
+ * GENERAL_BSC requires bsc_init (done by lfzip_init).
+ */
+ssize_t shuffle_compress        (double* in, ssize_t len, uint8_t** out, int codec, int mode);
+ssize_t shuffle_decompress      (uint8_t* in, ssize_t len, double* out, double error);